@@ -45,8 +45,24 @@
 #include <ctype.h>
 #include <float.h>
 
-#ifdef ENABLE_LOCALES
-#include <locale.h>
+/* use SSE2 for the bulk string scans where the target guarantees it, define CJSON_DISABLE_SIMD to force the portable code */
+#if !defined(CJSON_DISABLE_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define CJSON_USE_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+/* unsigned 64 bit integer for the number and word-at-a-time paths: uint64_t where <stdint.h> exists, the MSVC
+ * builtin otherwise; CJSON_U64 writes a constant of that type without the C99 ULL suffix */
+#if defined(_MSC_VER) && (_MSC_VER < 1600)
+typedef unsigned __int64 cjson_u64;
+#define CJSON_U64(value) value##ui64
+#else
+#include <stdint.h>
+typedef uint64_t cjson_u64;
+#define CJSON_U64(value) UINT64_C(value)
 #endif
 
 #if defined(_MSC_VER)
@@ -275,17 +291,6 @@ CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
     }
 }
 
-/* get the decimal point character of the current locale */
-static unsigned char get_decimal_point(void)
-{
-#ifdef ENABLE_LOCALES
-    struct lconv *lconv = localeconv();
-    return (unsigned char) lconv->decimal_point[0];
-#else
-    return '.';
-#endif
-}
-
 typedef struct
 {
     const unsigned char *content;
@@ -293,6 +298,7 @@ typedef struct
     size_t offset;
     size_t depth; /* How deeply nested (in arrays/objects) is the input at the current offset. */
     internal_hooks hooks;
+    cJSON_bool in_situ; /* content is writable, strings are unescaped in place and referenced */
 } parse_buffer;
 
 /* check if the given size is left to read in a given parse buffer (starting with 1) */
@@ -303,61 +309,253 @@ typedef struct
 /* get a pointer to the buffer at the position */
 #define buffer_at_offset(buffer) ((buffer)->content + (buffer)->offset)
 
-/* Parse the input text to generate a number, and populate the result into item. */
+/* Clinger's fast path is only exact when doubles are evaluated in double precision (not x87 extended) */
+#if (defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)) || defined(__SSE2_MATH__) || defined(_M_X64)
+#define CJSON_EXACT_DOUBLE_ARITHMETIC
+#endif
+
+/* exactly representable powers of ten */
+static const double exact_powers_of_ten[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* significant digits handed to strtod by the slow path, enough to round any double correctly */
+#define NUMBER_MAX_DIGITS 768
+
+#define is_digit(character) (((character) >= '0') && ((character) <= '9'))
+
+/* Slow path for numbers the fast paths can't convert exactly: rewrite them as "digitsEexponent" without a decimal
+ * point, so strtod gives the correctly rounded result without depending on the locale. */
+static double parse_number_slow(const cJSON_bool negative, const unsigned char * const integer, const size_t integer_length, const unsigned char * const fraction, const size_t fraction_length, long exponent)
+{
+    unsigned char number_c_string[NUMBER_MAX_DIGITS + 32];
+    unsigned char exponent_digits[24];
+    size_t length = 0;
+    size_t exponent_length = 0;
+    size_t i = 0;
+    unsigned long exponent_magnitude = 0;
+    cJSON_bool leading = true;
+    cJSON_bool sticky = false;
+
+    if (negative)
+    {
+        number_c_string[length++] = '-';
+    }
+
+    exponent -= (long)fraction_length;
+    for (i = 0; i < (integer_length + fraction_length); i++)
+    {
+        unsigned char digit = (i < integer_length) ? integer[i] : fraction[i - integer_length];
+        if (leading && (digit == '0'))
+        {
+            continue;
+        }
+        leading = false;
+
+        if ((length - (negative ? 1 : 0)) < NUMBER_MAX_DIGITS)
+        {
+            number_c_string[length++] = digit;
+        }
+        else
+        {
+            /* the dropped digits only matter as a tie breaker */
+            exponent++;
+            sticky = sticky || (digit != '0');
+        }
+    }
+    if (sticky)
+    {
+        number_c_string[length++] = '1';
+        exponent--;
+    }
+    if (leading)
+    {
+        number_c_string[length++] = '0';
+    }
+
+    number_c_string[length++] = 'e';
+    if (exponent < 0)
+    {
+        number_c_string[length++] = '-';
+        exponent_magnitude = (unsigned long)(-exponent);
+    }
+    else
+    {
+        exponent_magnitude = (unsigned long)exponent;
+    }
+    do
+    {
+        exponent_digits[exponent_length++] = (unsigned char)('0' + (exponent_magnitude % 10));
+        exponent_magnitude /= 10;
+    }
+    while (exponent_magnitude != 0);
+    while (exponent_length > 0)
+    {
+        number_c_string[length++] = exponent_digits[--exponent_length];
+    }
+    number_c_string[length] = '\0';
+
+    return strtod((const char*)number_c_string, NULL);
+}
+
+/* Parse the input text to generate a number, and populate the result into item.
+ * Accepts the same prefix strtod would have accepted. Integers and short decimals are converted exactly without
+ * calling into libc (the fast paths of Clinger and fast_float), everything else goes through parse_number_slow. */
 static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_buffer)
 {
-    double number = 0;
-    unsigned char *after_end = NULL;
-    unsigned char number_c_string[64];
-    unsigned char decimal_point = get_decimal_point();
+    const unsigned char *input = NULL;
+    const unsigned char *integer = NULL;
+    const unsigned char *fraction = NULL;
+    size_t available = 0;
     size_t i = 0;
+    size_t integer_length = 0;
+    size_t fraction_length = 0;
+    cjson_u64 mantissa = 0;
+    int significant_digits = 0;
+    long decimal_exponent = 0; /* number == mantissa * 10^decimal_exponent unless truncated */
+    long explicit_exponent = 0;
+    cJSON_bool negative = false;
+    cJSON_bool truncated = false;
+    cJSON_bool converted = false;
+    double number = 0;
 
     if ((input_buffer == NULL) || (input_buffer->content == NULL))
     {
         return false;
     }
 
-    /* copy the number into a temporary buffer and replace '.' with the decimal point
-     * of the current locale (for strtod)
-     * This also takes care of '\0' not necessarily being available for marking the end of the input */
-    for (i = 0; (i < (sizeof(number_c_string) - 1)) && can_access_at_index(input_buffer, i); i++)
-    {
-        switch (buffer_at_offset(input_buffer)[i])
-        {
-            case '0':
-            case '1':
-            case '2':
-            case '3':
-            case '4':
-            case '5':
-            case '6':
-            case '7':
-            case '8':
-            case '9':
-            case '+':
-            case '-':
-            case 'e':
-            case 'E':
-                number_c_string[i] = buffer_at_offset(input_buffer)[i];
-                break;
+    input = buffer_at_offset(input_buffer);
+    available = input_buffer->length - input_buffer->offset;
 
-            case '.':
-                number_c_string[i] = decimal_point;
-                break;
+    if ((i < available) && ((input[i] == '-') || (input[i] == '+')))
+    {
+        negative = (input[i] == '-');
+        i++;
+    }
 
-            default:
-                goto loop_end;
+    integer = input + i;
+    for (; (i < available) && is_digit(input[i]); i++)
+    {
+        if (significant_digits < 19)
+        {
+            mantissa = (mantissa * 10) + (cjson_u64)(input[i] - '0');
+            if (mantissa != 0)
+            {
+                significant_digits++;
+            }
+        }
+        else
+        {
+            truncated = truncated || (input[i] != '0');
+            decimal_exponent++;
+        }
+    }
+    integer_length = (size_t)((input + i) - integer);
+
+    if ((i < available) && (input[i] == '.'))
+    {
+        i++;
+        fraction = input + i;
+        for (; (i < available) && is_digit(input[i]); i++)
+        {
+            if (significant_digits < 19)
+            {
+                mantissa = (mantissa * 10) + (cjson_u64)(input[i] - '0');
+                decimal_exponent--;
+                if (mantissa != 0)
+                {
+                    significant_digits++;
+                }
+            }
+            else
+            {
+                truncated = truncated || (input[i] != '0');
+            }
         }
+        fraction_length = (size_t)((input + i) - fraction);
     }
-loop_end:
-    number_c_string[i] = '\0';
 
-    number = strtod((const char*)number_c_string, (char**)&after_end);
-    if (number_c_string == after_end)
+    if ((integer_length + fraction_length) == 0)
     {
         return false; /* parse_error */
     }
 
+    /* the exponent only counts if it has digits */
+    if (((i + 1) < available) && ((input[i] == 'e') || (input[i] == 'E')))
+    {
+        size_t exponent_start = i + 1;
+        cJSON_bool negative_exponent = false;
+
+        if ((input[exponent_start] == '-') || (input[exponent_start] == '+'))
+        {
+            negative_exponent = (input[exponent_start] == '-');
+            exponent_start++;
+        }
+        if ((exponent_start < available) && is_digit(input[exponent_start]))
+        {
+            for (i = exponent_start; (i < available) && is_digit(input[i]); i++)
+            {
+                /* saturate far beyond the range of double */
+                if (explicit_exponent < 100000)
+                {
+                    explicit_exponent = (explicit_exponent * 10) + (long)(input[i] - '0');
+                }
+            }
+            if (negative_exponent)
+            {
+                explicit_exponent = -explicit_exponent;
+            }
+        }
+    }
+    decimal_exponent += explicit_exponent;
+
+    if (mantissa == 0)
+    {
+        number = 0.0;
+        converted = !truncated;
+    }
+    else if (!truncated && (decimal_exponent == 0))
+    {
+        /* integers up to 19 digits, the conversion is correctly rounded */
+        number = (double)mantissa;
+        converted = true;
+    }
+#ifdef CJSON_EXACT_DOUBLE_ARITHMETIC
+    else if (!truncated && (mantissa <= (CJSON_U64(1) << 53)) && (decimal_exponent >= -22) && (decimal_exponent <= (22 + 15)))
+    {
+        /* mantissa and power of ten are exact, so a single rounding step gives the exact result */
+        if (decimal_exponent < 0)
+        {
+            number = (double)mantissa / exact_powers_of_ten[-decimal_exponent];
+            converted = true;
+        }
+        else
+        {
+            /* move the excess over 10^22 into the mantissa while it stays exact */
+            for (; (decimal_exponent > 22) && (mantissa <= ((CJSON_U64(1) << 53) / 10)); decimal_exponent--)
+            {
+                mantissa *= 10;
+            }
+            if (decimal_exponent <= 22)
+            {
+                number = (double)mantissa * exact_powers_of_ten[decimal_exponent];
+                converted = true;
+            }
+        }
+    }
+#endif
+
+    if (!converted)
+    {
+        number = parse_number_slow(negative, integer, integer_length, fraction, fraction_length, explicit_exponent);
+    }
+    else if (negative)
+    {
+        number = -number;
+    }
+
     item->valuedouble = number;
 
     /* use saturation in case of overflow */
@@ -376,7 +574,7 @@ loop_end:
 
     item->type = cJSON_Number;
 
-    input_buffer->offset += (size_t)(after_end - number_c_string);
+    input_buffer->offset += i;
     return true;
 }
 
@@ -452,6 +650,11 @@ typedef struct
     cJSON_bool noalloc;
     cJSON_bool format; /* is this print a formatted print */
     internal_hooks hooks;
+    cJSON_FlushCallback flush; /* streaming print: full chunks go here instead of growing the buffer */
+    void *flush_context;
+    size_t flushed; /* bytes handed to flush so far */
+    size_t peak; /* largest buffer size ensure was asked for, counted from the start of the text */
+    cJSON_bool borrowed; /* buffer belongs to the caller, grow into a copy instead of reallocating it */
 } printbuffer;
 
 /* realloc printbuffer if necessary to have at least "needed" bytes more */
@@ -478,11 +681,31 @@ static unsigned char* ensure(printbuffer * const p, size_t needed)
     }
 
     needed += p->offset + 1;
+    if ((p->flushed + needed) > p->peak)
+    {
+        p->peak = p->flushed + needed;
+    }
     if (needed <= p->length)
     {
         return p->buffer + p->offset;
     }
 
+    if ((p->flush != NULL) && (p->offset > 0))
+    {
+        /* hand over what was printed so far and start the chunk again */
+        if (!p->flush(p->flush_context, (const char*)p->buffer, p->offset))
+        {
+            return NULL;
+        }
+        needed -= p->offset;
+        p->flushed += p->offset;
+        p->offset = 0;
+        if (needed <= p->length)
+        {
+            return p->buffer;
+        }
+    }
+
     if (p->noalloc) {
         return NULL;
     }
@@ -505,7 +728,7 @@ static unsigned char* ensure(printbuffer * const p, size_t needed)
         newsize = needed * 2;
     }
 
-    if (p->hooks.reallocate != NULL)
+    if ((p->hooks.reallocate != NULL) && !p->borrowed)
     {
         /* reallocate with realloc if available */
         newbuffer = (unsigned char*)p->hooks.reallocate(p->buffer, newsize);
@@ -524,7 +747,10 @@ static unsigned char* ensure(printbuffer * const p, size_t needed)
         newbuffer = (unsigned char*)p->hooks.allocate(newsize);
         if (!newbuffer)
         {
-            p->hooks.deallocate(p->buffer);
+            if (!p->borrowed)
+            {
+                p->hooks.deallocate(p->buffer);
+            }
             p->length = 0;
             p->buffer = NULL;
 
@@ -532,7 +758,11 @@ static unsigned char* ensure(printbuffer * const p, size_t needed)
         }
 
         memcpy(newbuffer, p->buffer, p->offset + 1);
-        p->hooks.deallocate(p->buffer);
+        if (!p->borrowed)
+        {
+            p->hooks.deallocate(p->buffer);
+        }
+        p->borrowed = false;
     }
     p->length = newsize;
     p->buffer = newbuffer;
@@ -560,153 +790,509 @@ static cJSON_bool compare_double(double a, double b)
     return (fabs(a - b) <= maxVal * DBL_EPSILON);
 }
 
-/* Render the number nicely from the given item into a string. */
-static cJSON_bool print_number(const cJSON * const item, printbuffer * const output_buffer)
+/* Shortest round-trip double to text conversion (Grisu2 by Florian Loitsch, "Printing Floating-Point Numbers
+ * Quickly and Accurately with Integers", PLDI 2010). The digits always read back to the same double and are the
+ * shortest such digits for all but a tiny fraction of inputs. */
+
+/* a floating point number f * 2^e with a 64 bit significand */
+typedef struct
 {
-    unsigned char *output_pointer = NULL;
-    double d = item->valuedouble;
-    int length = 0;
-    size_t i = 0;
-    unsigned char number_buffer[26] = {0}; /* temporary buffer to print the number into */
-    unsigned char decimal_point = get_decimal_point();
-    double test = 0.0;
+    cjson_u64 f;
+    int e;
+} diy_fp;
 
-    if (output_buffer == NULL)
-    {
-        return false;
-    }
+#define DOUBLE_SIGNIFICAND_MASK CJSON_U64(0x000FFFFFFFFFFFFF)
+#define DOUBLE_HIDDEN_BIT CJSON_U64(0x0010000000000000)
+#define DOUBLE_EXPONENT_BIAS (0x3FF + 52)
 
-    /* This checks for NaN and Infinity */
-    if (isnan(d) || isinf(d))
+/* normalized 64 bit approximations of 10^k for k = -348, -340, ..., 340 */
+static const cjson_u64 cached_powers_f[] =
+{
+    CJSON_U64(0xFA8FD5A0081C0288), CJSON_U64(0xBAAEE17FA23EBF76), CJSON_U64(0x8B16FB203055AC76),
+    CJSON_U64(0xCF42894A5DCE35EA), CJSON_U64(0x9A6BB0AA55653B2D), CJSON_U64(0xE61ACF033D1A45DF),
+    CJSON_U64(0xAB70FE17C79AC6CA), CJSON_U64(0xFF77B1FCBEBCDC4F), CJSON_U64(0xBE5691EF416BD60C),
+    CJSON_U64(0x8DD01FAD907FFC3C), CJSON_U64(0xD3515C2831559A83), CJSON_U64(0x9D71AC8FADA6C9B5),
+    CJSON_U64(0xEA9C227723EE8BCB), CJSON_U64(0xAECC49914078536D), CJSON_U64(0x823C12795DB6CE57),
+    CJSON_U64(0xC21094364DFB5637), CJSON_U64(0x9096EA6F3848984F), CJSON_U64(0xD77485CB25823AC7),
+    CJSON_U64(0xA086CFCD97BF97F4), CJSON_U64(0xEF340A98172AACE5), CJSON_U64(0xB23867FB2A35B28E),
+    CJSON_U64(0x84C8D4DFD2C63F3B), CJSON_U64(0xC5DD44271AD3CDBA), CJSON_U64(0x936B9FCEBB25C996),
+    CJSON_U64(0xDBAC6C247D62A584), CJSON_U64(0xA3AB66580D5FDAF6), CJSON_U64(0xF3E2F893DEC3F126),
+    CJSON_U64(0xB5B5ADA8AAFF80B8), CJSON_U64(0x87625F056C7C4A8B), CJSON_U64(0xC9BCFF6034C13053),
+    CJSON_U64(0x964E858C91BA2655), CJSON_U64(0xDFF9772470297EBD), CJSON_U64(0xA6DFBD9FB8E5B88F),
+    CJSON_U64(0xF8A95FCF88747D94), CJSON_U64(0xB94470938FA89BCF), CJSON_U64(0x8A08F0F8BF0F156B),
+    CJSON_U64(0xCDB02555653131B6), CJSON_U64(0x993FE2C6D07B7FAC), CJSON_U64(0xE45C10C42A2B3B06),
+    CJSON_U64(0xAA242499697392D3), CJSON_U64(0xFD87B5F28300CA0E), CJSON_U64(0xBCE5086492111AEB),
+    CJSON_U64(0x8CBCCC096F5088CC), CJSON_U64(0xD1B71758E219652C), CJSON_U64(0x9C40000000000000),
+    CJSON_U64(0xE8D4A51000000000), CJSON_U64(0xAD78EBC5AC620000), CJSON_U64(0x813F3978F8940984),
+    CJSON_U64(0xC097CE7BC90715B3), CJSON_U64(0x8F7E32CE7BEA5C70), CJSON_U64(0xD5D238A4ABE98068),
+    CJSON_U64(0x9F4F2726179A2245), CJSON_U64(0xED63A231D4C4FB27), CJSON_U64(0xB0DE65388CC8ADA8),
+    CJSON_U64(0x83C7088E1AAB65DB), CJSON_U64(0xC45D1DF942711D9A), CJSON_U64(0x924D692CA61BE758),
+    CJSON_U64(0xDA01EE641A708DEA), CJSON_U64(0xA26DA3999AEF774A), CJSON_U64(0xF209787BB47D6B85),
+    CJSON_U64(0xB454E4A179DD1877), CJSON_U64(0x865B86925B9BC5C2), CJSON_U64(0xC83553C5C8965D3D),
+    CJSON_U64(0x952AB45CFA97A0B3), CJSON_U64(0xDE469FBD99A05FE3), CJSON_U64(0xA59BC234DB398C25),
+    CJSON_U64(0xF6C69A72A3989F5C), CJSON_U64(0xB7DCBF5354E9BECE), CJSON_U64(0x88FCF317F22241E2),
+    CJSON_U64(0xCC20CE9BD35C78A5), CJSON_U64(0x98165AF37B2153DF), CJSON_U64(0xE2A0B5DC971F303A),
+    CJSON_U64(0xA8D9D1535CE3B396), CJSON_U64(0xFB9B7CD9A4A7443C), CJSON_U64(0xBB764C4CA7A44410),
+    CJSON_U64(0x8BAB8EEFB6409C1A), CJSON_U64(0xD01FEF10A657842C), CJSON_U64(0x9B10A4E5E9913129),
+    CJSON_U64(0xE7109BFBA19C0C9D), CJSON_U64(0xAC2820D9623BF429), CJSON_U64(0x80444B5E7AA7CF85),
+    CJSON_U64(0xBF21E44003ACDD2D), CJSON_U64(0x8E679C2F5E44FF8F), CJSON_U64(0xD433179D9C8CB841),
+    CJSON_U64(0x9E19DB92B4E31BA9), CJSON_U64(0xEB96BF6EBADF77D9), CJSON_U64(0xAF87023B9BF0EE6B),
+};
+static const short cached_powers_e[] =
+{
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954,
+    -927, -901, -874, -847, -821, -794, -768, -741, -715, -688, -661,
+    -635, -608, -582, -555, -529, -502, -475, -449, -422, -396, -369,
+    -343, -316, -289, -263, -236, -210, -183, -157, -130, -103, -77,
+    -50, -24, 3, 30, 56, 83, 109, 136, 162, 189, 216,
+    242, 269, 295, 322, 348, 375, 402, 428, 455, 481, 508,
+    534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800,
+    827, 853, 880, 907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const cjson_u64 powers_of_ten[] =
+{
+    CJSON_U64(1), CJSON_U64(10), CJSON_U64(100), CJSON_U64(1000), CJSON_U64(10000), CJSON_U64(100000), CJSON_U64(1000000), CJSON_U64(10000000), CJSON_U64(100000000),
+    CJSON_U64(1000000000), CJSON_U64(10000000000), CJSON_U64(100000000000), CJSON_U64(1000000000000), CJSON_U64(10000000000000),
+    CJSON_U64(100000000000000), CJSON_U64(1000000000000000), CJSON_U64(10000000000000000), CJSON_U64(100000000000000000),
+    CJSON_U64(1000000000000000000), CJSON_U64(10000000000000000000)
+};
+
+/* 64x64 bit multiplication keeping the rounded upper 64 bits */
+static diy_fp diy_fp_multiply(const diy_fp x, const diy_fp y)
+{
+    const cjson_u64 mask = CJSON_U64(0xFFFFFFFF);
+    const cjson_u64 a = x.f >> 32;
+    const cjson_u64 b = x.f & mask;
+    const cjson_u64 c = y.f >> 32;
+    const cjson_u64 d = y.f & mask;
+    const cjson_u64 bd = b * d;
+    const cjson_u64 ad = a * d;
+    const cjson_u64 bc = b * c;
+    cjson_u64 middle = (bd >> 32) + (ad & mask) + (bc & mask);
+    diy_fp product;
+
+    middle += CJSON_U64(1) << 31; /* round */
+    product.f = (a * c) + (ad >> 32) + (bc >> 32) + (middle >> 32);
+    product.e = x.e + y.e + 64;
+
+    return product;
+}
+
+static diy_fp diy_fp_normalize(diy_fp x)
+{
+    while (!(x.f & (CJSON_U64(1) << 63)))
     {
-        length = sprintf((char*)number_buffer, "null");
+        x.f <<= 1;
+        x.e--;
     }
-    else if(d == (double)item->valueint)
+
+    return x;
+}
+
+/* split a positive finite double into its normalized value and the normalized boundaries halfway to its neighbours */
+static void diy_fp_boundaries(const double d, diy_fp * const value, diy_fp * const minus, diy_fp * const plus)
+{
+    cjson_u64 bits = 0;
+    int biased_exponent = 0;
+    diy_fp v;
+    diy_fp upper;
+    diy_fp lower;
+
+    memcpy(&bits, &d, sizeof(bits));
+    biased_exponent = (int)((bits >> 52) & 0x7FF);
+    v.f = bits & DOUBLE_SIGNIFICAND_MASK;
+    if (biased_exponent != 0)
     {
-        length = sprintf((char*)number_buffer, "%d", item->valueint);
+        v.f += DOUBLE_HIDDEN_BIT;
+        v.e = biased_exponent - DOUBLE_EXPONENT_BIAS;
     }
     else
     {
-        /* Try 15 decimal places of precision to avoid nonsignificant nonzero digits */
-        length = sprintf((char*)number_buffer, "%1.15g", d);
-
-        /* Check whether the original double can be recovered */
-        if ((sscanf((char*)number_buffer, "%lg", &test) != 1) || !compare_double((double)test, d))
-        {
-            /* If not, print with 17 decimal places of precision */
-            length = sprintf((char*)number_buffer, "%1.17g", d);
-        }
+        /* subnormal */
+        v.e = 1 - DOUBLE_EXPONENT_BIAS;
     }
 
-    /* sprintf failed or buffer overrun occurred */
-    if ((length < 0) || (length > (int)(sizeof(number_buffer) - 1)))
+    upper.f = (v.f << 1) + 1;
+    upper.e = v.e - 1;
+    while (!(upper.f & (DOUBLE_HIDDEN_BIT << 1)))
     {
-        return false;
+        upper.f <<= 1;
+        upper.e--;
     }
+    upper.f <<= 64 - 52 - 2;
+    upper.e -= 64 - 52 - 2;
 
-    /* reserve appropriate space in the output */
-    output_pointer = ensure(output_buffer, (size_t)length + sizeof(""));
-    if (output_pointer == NULL)
+    /* the lower neighbour is closer if v is a power of two */
+    if (v.f == DOUBLE_HIDDEN_BIT)
     {
-        return false;
+        lower.f = (v.f << 2) - 1;
+        lower.e = v.e - 2;
     }
+    else
+    {
+        lower.f = (v.f << 1) - 1;
+        lower.e = v.e - 1;
+    }
+    lower.f <<= lower.e - upper.e;
+    lower.e = upper.e;
+
+    *value = diy_fp_normalize(v);
+    *minus = lower;
+    *plus = upper;
+}
+
+/* cached power c = 10^-k such that the product with a number of binary exponent e lands in [-60, -32] */
+static diy_fp cached_power(const int e, int * const k)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ceiling = (int)dk;
+    size_t index = 0;
+    diy_fp power;
 
-    /* copy the printed number to the output and replace locale
-     * dependent decimal point with '.' */
-    for (i = 0; i < ((size_t)length); i++)
+    if ((dk - ceiling) > 0.0)
     {
-        if (number_buffer[i] == decimal_point)
-        {
-            output_pointer[i] = '.';
-            continue;
-        }
+        ceiling++;
+    }
+    index = (size_t)((ceiling >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+
+    power.f = cached_powers_f[index];
+    power.e = cached_powers_e[index];
 
-        output_pointer[i] = number_buffer[i];
+    return power;
+}
+
+/* move the last digit towards w as long as the result stays inside the rounding interval */
+static void grisu_round(unsigned char * const digits, const int length, const cjson_u64 delta, cjson_u64 rest, const cjson_u64 ten_kappa, const cjson_u64 wp_w)
+{
+    while ((rest < wp_w) && ((delta - rest) >= ten_kappa)
+           && (((rest + ten_kappa) < wp_w) || ((wp_w - rest) > (rest + ten_kappa - wp_w))))
+    {
+        digits[length - 1]--;
+        rest += ten_kappa;
     }
-    output_pointer[i] = '\0';
+}
 
-    output_buffer->offset += (size_t)length;
+static int decimal_digit_count(const unsigned int n)
+{
+    int count = 1;
+    unsigned int limit = 10;
 
-    return true;
+    /* the integral part never has more than 9 digits with the chosen cached powers */
+    while ((count < 9) && (n >= limit))
+    {
+        count++;
+        limit *= 10;
+    }
+
+    return count;
 }
 
-/* parse 4 digit hexadecimal number */
-static unsigned parse_hex4(const unsigned char * const input)
+/* generate the digits of w in [minus, plus] (delta = plus - minus), returns the number of digits */
+static int grisu_digit_generation(const diy_fp w, const diy_fp plus, cjson_u64 delta, unsigned char * const digits, int * const k)
 {
-    unsigned int h = 0;
-    size_t i = 0;
+    const int shift = -plus.e;
+    const cjson_u64 one = CJSON_U64(1) << shift;
+    const cjson_u64 wp_w = plus.f - w.f;
+    unsigned int integral = (unsigned int)(plus.f >> shift);
+    cjson_u64 fractional = plus.f & (one - 1);
+    int kappa = decimal_digit_count(integral);
+    int length = 0;
 
-    for (i = 0; i < 4; i++)
+    while (kappa > 0)
     {
-        /* parse digit */
-        if ((input[i] >= '0') && (input[i] <= '9'))
-        {
-            h += (unsigned int) input[i] - '0';
-        }
-        else if ((input[i] >= 'A') && (input[i] <= 'F'))
+        unsigned int divisor = (unsigned int)powers_of_ten[kappa - 1];
+        unsigned int digit = integral / divisor;
+        cjson_u64 rest = 0;
+
+        integral %= divisor;
+        if ((digit != 0) || (length != 0))
         {
-            h += (unsigned int) 10 + input[i] - 'A';
+            digits[length++] = (unsigned char)('0' + digit);
         }
-        else if ((input[i] >= 'a') && (input[i] <= 'f'))
+        kappa--;
+
+        rest = ((cjson_u64)integral << shift) + fractional;
+        if (rest <= delta)
         {
-            h += (unsigned int) 10 + input[i] - 'a';
+            *k += kappa;
+            grisu_round(digits, length, delta, rest, powers_of_ten[kappa] << shift, wp_w);
+            return length;
         }
-        else /* invalid */
+    }
+
+    for (;;)
+    {
+        unsigned int digit = 0;
+
+        fractional *= 10;
+        delta *= 10;
+        digit = (unsigned int)(fractional >> shift);
+        if ((digit != 0) || (length != 0))
         {
-            return 0;
+            digits[length++] = (unsigned char)('0' + digit);
         }
-
-        if (i < 3)
+        fractional &= one - 1;
+        kappa--;
+        if (fractional < delta)
         {
-            /* shift left to make place for the next nibble */
-            h = h << 4;
+            *k += kappa;
+            grisu_round(digits, length, delta, fractional, one, wp_w * ((-kappa < 20) ? powers_of_ten[-kappa] : 0));
+            return length;
         }
     }
+}
 
-    return h;
+/* shortest decimal digits of a positive finite double d, so that d == digits * 10^k */
+static int grisu2(const double d, unsigned char * const digits, int * const k)
+{
+    diy_fp value;
+    diy_fp minus;
+    diy_fp plus;
+    diy_fp power;
+
+    diy_fp_boundaries(d, &value, &minus, &plus);
+    power = cached_power(plus.e, k);
+
+    value = diy_fp_multiply(value, power);
+    plus = diy_fp_multiply(plus, power);
+    minus = diy_fp_multiply(minus, power);
+    /* stay strictly inside the rounding interval */
+    minus.f++;
+    plus.f--;
+
+    return grisu_digit_generation(value, plus, plus.f - minus.f, digits, k);
 }
 
-/* converts a UTF-16 literal to UTF-8
- * A literal can be one or two sequences of the form \uXXXX */
-static unsigned char utf16_literal_to_utf8(const unsigned char * const input_pointer, const unsigned char * const input_end, unsigned char **output_pointer)
+/* write the decimal digits of an integer with |number| < 2^53, returns the length */
+static int print_integer(const double number, unsigned char * const output)
 {
-    long unsigned int codepoint = 0;
-    unsigned int first_code = 0;
-    const unsigned char *first_sequence = input_pointer;
-    unsigned char utf8_length = 0;
-    unsigned char utf8_position = 0;
-    unsigned char sequence_length = 0;
-    unsigned char first_byte_mark = 0;
+    cjson_u64 magnitude = (cjson_u64)fabs(number);
+    unsigned char reversed[20];
+    int reversed_length = 0;
+    int length = 0;
 
-    if ((input_end - first_sequence) < 6)
+    if (number < 0)
     {
-        /* input ends unexpectedly */
-        goto fail;
+        output[length++] = '-';
     }
 
-    /* get the first utf16 sequence */
-    first_code = parse_hex4(first_sequence + 2);
+    do
+    {
+        reversed[reversed_length++] = (unsigned char)('0' + (magnitude % 10));
+        magnitude /= 10;
+    }
+    while (magnitude != 0);
 
-    /* check that the code is valid */
-    if (((first_code >= 0xDC00) && (first_code <= 0xDFFF)))
+    while (reversed_length > 0)
     {
-        goto fail;
+        output[length++] = reversed[--reversed_length];
     }
 
-    /* UTF16 surrogate pair */
-    if ((first_code >= 0xD800) && (first_code <= 0xDBFF))
+    return length;
+}
+
+/* write a finite non-integral double with its shortest round-trip digits, laid out like printf's %g:
+ * positional notation for decimal exponents in [-4, max(15, digits)), scientific notation with at least two
+ * exponent digits otherwise. Returns the length. */
+static int print_shortest(const double number, unsigned char * const output)
+{
+    unsigned char digits[18];
+    int digit_count = 0;
+    int k = 0;
+    int exponent = 0;
+    int length = 0;
+    int i = 0;
+
+    if (number < 0)
     {
-        const unsigned char *second_sequence = first_sequence + 6;
-        unsigned int second_code = 0;
-        sequence_length = 12; /* \uXXXX\uXXXX */
+        output[length++] = '-';
+    }
 
-        if ((input_end - second_sequence) < 6)
-        {
-            /* input ends unexpectedly */
-            goto fail;
-        }
+    digit_count = grisu2(fabs(number), digits, &k);
+    /* scientific exponent of the first digit */
+    exponent = digit_count + k - 1;
 
-        if ((second_sequence[0] != '\\') || (second_sequence[1] != 'u'))
+    if ((exponent >= -4) && (exponent < ((digit_count > 15) ? digit_count : 15)))
+    {
+        if (exponent < 0)
+        {
+            output[length++] = '0';
+            output[length++] = '.';
+            for (i = -1; i > exponent; i--)
+            {
+                output[length++] = '0';
+            }
+            memcpy(output + length, digits, (size_t)digit_count);
+            length += digit_count;
+        }
+        else if (digit_count <= (exponent + 1))
+        {
+            memcpy(output + length, digits, (size_t)digit_count);
+            length += digit_count;
+            for (i = digit_count; i <= exponent; i++)
+            {
+                output[length++] = '0';
+            }
+        }
+        else
+        {
+            memcpy(output + length, digits, (size_t)(exponent + 1));
+            length += exponent + 1;
+            output[length++] = '.';
+            memcpy(output + length, digits + exponent + 1, (size_t)(digit_count - exponent - 1));
+            length += digit_count - exponent - 1;
+        }
+
+        return length;
+    }
+
+    output[length++] = digits[0];
+    if (digit_count > 1)
+    {
+        output[length++] = '.';
+        memcpy(output + length, digits + 1, (size_t)(digit_count - 1));
+        length += digit_count - 1;
+    }
+    output[length++] = 'e';
+    output[length++] = (exponent < 0) ? '-' : '+';
+    if (exponent < 0)
+    {
+        exponent = -exponent;
+    }
+    if (exponent >= 100)
+    {
+        output[length++] = (unsigned char)('0' + (exponent / 100));
+    }
+    output[length++] = (unsigned char)('0' + ((exponent / 10) % 10));
+    output[length++] = (unsigned char)('0' + (exponent % 10));
+
+    return length;
+}
+
+/* Render the number nicely from the given item into a string. */
+static cJSON_bool print_number(const cJSON * const item, printbuffer * const output_buffer)
+{
+    unsigned char *output_pointer = NULL;
+    double d = item->valuedouble;
+    int length = 0;
+    unsigned char number_buffer[26] = {0}; /* temporary buffer to print the number into */
+
+    if (output_buffer == NULL)
+    {
+        return false;
+    }
+
+    /* This checks for NaN and Infinity */
+    if (isnan(d) || isinf(d))
+    {
+        memcpy(number_buffer, "null", 4);
+        length = 4;
+    }
+    else if ((d == floor(d)) && (fabs(d) < 9007199254740992.0))
+    {
+        /* integers (ids, sequence numbers, timestamps) skip the digit generation; below 2^53 every one of them is
+         * exact, so they are written in full instead of switching to an exponent at 1e15 like %g would */
+        length = print_integer(d, number_buffer);
+    }
+    else
+    {
+        length = print_shortest(d, number_buffer);
+    }
+
+    /* reserve appropriate space in the output */
+    output_pointer = ensure(output_buffer, (size_t)length + sizeof(""));
+    if (output_pointer == NULL)
+    {
+        return false;
+    }
+
+    memcpy(output_pointer, number_buffer, (size_t)length);
+    output_pointer[length] = '\0';
+
+    output_buffer->offset += (size_t)length;
+
+    return true;
+}
+
+/* parse 4 digit hexadecimal number */
+static unsigned parse_hex4(const unsigned char * const input)
+{
+    unsigned int h = 0;
+    size_t i = 0;
+
+    for (i = 0; i < 4; i++)
+    {
+        /* parse digit */
+        if ((input[i] >= '0') && (input[i] <= '9'))
+        {
+            h += (unsigned int) input[i] - '0';
+        }
+        else if ((input[i] >= 'A') && (input[i] <= 'F'))
+        {
+            h += (unsigned int) 10 + input[i] - 'A';
+        }
+        else if ((input[i] >= 'a') && (input[i] <= 'f'))
+        {
+            h += (unsigned int) 10 + input[i] - 'a';
+        }
+        else /* invalid */
+        {
+            return 0;
+        }
+
+        if (i < 3)
+        {
+            /* shift left to make place for the next nibble */
+            h = h << 4;
+        }
+    }
+
+    return h;
+}
+
+/* converts a UTF-16 literal to UTF-8
+ * A literal can be one or two sequences of the form \uXXXX */
+static unsigned char utf16_literal_to_utf8(const unsigned char * const input_pointer, const unsigned char * const input_end, unsigned char **output_pointer)
+{
+    long unsigned int codepoint = 0;
+    unsigned int first_code = 0;
+    const unsigned char *first_sequence = input_pointer;
+    unsigned char utf8_length = 0;
+    unsigned char utf8_position = 0;
+    unsigned char sequence_length = 0;
+    unsigned char first_byte_mark = 0;
+
+    if ((input_end - first_sequence) < 6)
+    {
+        /* input ends unexpectedly */
+        goto fail;
+    }
+
+    /* get the first utf16 sequence */
+    first_code = parse_hex4(first_sequence + 2);
+
+    /* check that the code is valid */
+    if (((first_code >= 0xDC00) && (first_code <= 0xDFFF)))
+    {
+        goto fail;
+    }
+
+    /* UTF16 surrogate pair */
+    if ((first_code >= 0xD800) && (first_code <= 0xDBFF))
+    {
+        const unsigned char *second_sequence = first_sequence + 6;
+        unsigned int second_code = 0;
+        sequence_length = 12; /* \uXXXX\uXXXX */
+
+        if ((input_end - second_sequence) < 6)
+        {
+            /* input ends unexpectedly */
+            goto fail;
+        }
+
+        if ((second_sequence[0] != '\\') || (second_sequence[1] != 'u'))
         {
             /* missing second half of the surrogate pair */
             goto fail;
@@ -788,55 +1374,15 @@ fail:
     return 0;
 }
 
-/* Parse the input text into an unescaped cinput, and populate item. */
-static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_buffer)
-{
-    const unsigned char *input_pointer = buffer_at_offset(input_buffer) + 1;
-    const unsigned char *input_end = buffer_at_offset(input_buffer) + 1;
-    unsigned char *output_pointer = NULL;
-    unsigned char *output = NULL;
-
-    /* not a string */
-    if (buffer_at_offset(input_buffer)[0] != '\"')
-    {
-        goto fail;
-    }
-
-    {
-        /* calculate approximate size of the output (overestimate) */
-        size_t allocation_length = 0;
-        size_t skipped_bytes = 0;
-        while (((size_t)(input_end - input_buffer->content) < input_buffer->length) && (*input_end != '\"'))
-        {
-            /* is escape sequence */
-            if (input_end[0] == '\\')
-            {
-                if ((size_t)(input_end + 1 - input_buffer->content) >= input_buffer->length)
-                {
-                    /* prevent buffer overflow when last input character is a backslash */
-                    goto fail;
-                }
-                skipped_bytes++;
-                input_end++;
-            }
-            input_end++;
-        }
-        if (((size_t)(input_end - input_buffer->content) >= input_buffer->length) || (*input_end != '\"'))
-        {
-            goto fail; /* string ended unexpectedly */
-        }
+static void* cast_away_const(const void* string);
 
-        /* This is at most how much we need for the output */
-        allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
-        output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
-        if (output == NULL)
-        {
-            goto fail; /* allocation failure */
-        }
-    }
+/* Unescape the string literal from *input (after the opening quote) to input_end (the closing quote) into *output and
+ * zero terminate it. The output is never longer than the literal. On failure *input is left at the bad sequence. */
+static cJSON_bool unescape_string(const unsigned char ** const input, const unsigned char * const input_end, unsigned char ** const output)
+{
+    const unsigned char *input_pointer = *input;
+    unsigned char *output_pointer = *output;
 
-    output_pointer = output;
-    /* loop through the string literal */
     while (input_pointer < input_end)
     {
         if (*input_pointer != '\\')
@@ -895,8 +1441,85 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     /* zero terminate the output */
     *output_pointer = '\0';
 
+    *input = input_pointer;
+    *output = output_pointer;
+
+    return true;
+
+fail:
+    *input = input_pointer;
+
+    return false;
+}
+
+/* Parse the input text into an unescaped cinput, and populate item. */
+static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_buffer)
+{
+    const unsigned char *input_pointer = buffer_at_offset(input_buffer) + 1;
+    const unsigned char *input_end = buffer_at_offset(input_buffer) + 1;
+    unsigned char *output_pointer = NULL;
+    unsigned char *output = NULL;
+
+    /* not a string */
+    if (buffer_at_offset(input_buffer)[0] != '\"')
+    {
+        goto fail;
+    }
+
+    {
+        /* calculate approximate size of the output (overestimate) */
+        size_t allocation_length = 0;
+        size_t skipped_bytes = 0;
+        while (((size_t)(input_end - input_buffer->content) < input_buffer->length) && (*input_end != '\"'))
+        {
+            /* is escape sequence */
+            if (input_end[0] == '\\')
+            {
+                if ((size_t)(input_end + 1 - input_buffer->content) >= input_buffer->length)
+                {
+                    /* prevent buffer overflow when last input character is a backslash */
+                    goto fail;
+                }
+                skipped_bytes++;
+                input_end++;
+            }
+            input_end++;
+        }
+        if (((size_t)(input_end - input_buffer->content) >= input_buffer->length) || (*input_end != '\"'))
+        {
+            goto fail; /* string ended unexpectedly */
+        }
+
+        if (input_buffer->in_situ)
+        {
+            /* the unescaped string is never longer than the literal, so it overwrites the literal itself */
+            output = (unsigned char*)cast_away_const(input_pointer);
+        }
+        else
+        {
+            /* This is at most how much we need for the output */
+            allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
+            output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
+            if (output == NULL)
+            {
+                goto fail; /* allocation failure */
+            }
+        }
+    }
+
+    output_pointer = output;
+    if (!unescape_string(&input_pointer, input_end, &output_pointer))
+    {
+        goto fail;
+    }
+
     item->type = cJSON_String;
     item->valuestring = (char*)output;
+    if (input_buffer->in_situ)
+    {
+        /* points into the caller's buffer, not to be freed */
+        item->type |= cJSON_IsReference;
+    }
 
     input_buffer->offset = (size_t) (input_end - input_buffer->content);
     input_buffer->offset++;
@@ -904,7 +1527,7 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     return true;
 
 fail:
-    if (output != NULL)
+    if ((output != NULL) && !input_buffer->in_situ)
     {
         input_buffer->hooks.deallocate(output);
         output = NULL;
@@ -918,19 +1541,122 @@ fail:
     return false;
 }
 
-/* Render the cstring provided to an escaped version that can be printed. */
-static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffer * const output_buffer)
+/* number of additional characters needed to escape c, 0 if it can be copied verbatim */
+static size_t escape_length(const unsigned char c)
 {
-    const unsigned char *input_pointer = NULL;
-    unsigned char *output = NULL;
-    unsigned char *output_pointer = NULL;
-    size_t output_length = 0;
-    /* numbers of additional characters needed for escaping */
-    size_t escape_characters = 0;
-
-    if (output_buffer == NULL)
-    {
-        return false;
+    switch (c)
+    {
+        case '\"':
+        case '\\':
+        case '\b':
+        case '\f':
+        case '\n':
+        case '\r':
+        case '\t':
+            /* one character escape sequence */
+            return 1;
+        default:
+            if (c < 32)
+            {
+                /* UTF-16 escape sequence uXXXX */
+                return 5;
+            }
+            return 0;
+    }
+}
+
+#ifdef CJSON_USE_SSE2
+/* index of the lowest set bit, mask must not be 0 */
+static size_t lowest_set_bit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward(&index, mask);
+    return (size_t)index;
+#else
+    return (size_t)__builtin_ctz(mask);
+#endif
+}
+#endif
+
+/* Find the first character in the length bytes at input that has to be escaped (control characters, '\"' and '\\').
+ * Blocks without such characters are skipped 16 bytes at a time with SSE2, or 8 bytes at a time with a portable
+ * word-at-a-time test. Returns length if nothing has to be escaped. */
+static size_t find_escape(const unsigned char * const input, const size_t length)
+{
+    size_t offset = 0;
+
+#ifdef CJSON_USE_SSE2
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i last_control = _mm_set1_epi8(31);
+
+    for (; (offset + 16) <= length; offset += 16)
+    {
+        const __m128i block = _mm_loadu_si128((const __m128i*)(const void*)(input + offset));
+        /* max(c, 31) == 31 exactly for the unsigned bytes below 32 */
+        __m128i needs_escape = _mm_cmpeq_epi8(_mm_max_epu8(block, last_control), last_control);
+        unsigned int mask = 0;
+
+        needs_escape = _mm_or_si128(needs_escape, _mm_cmpeq_epi8(block, quote));
+        needs_escape = _mm_or_si128(needs_escape, _mm_cmpeq_epi8(block, backslash));
+        mask = (unsigned int)_mm_movemask_epi8(needs_escape);
+        if (mask != 0)
+        {
+            return offset + lowest_set_bit(mask);
+        }
+    }
+#else
+    const cjson_u64 ones = CJSON_U64(0x0101010101010101);
+    const cjson_u64 highs = CJSON_U64(0x8080808080808080);
+
+    for (; (offset + 8) <= length; offset += 8)
+    {
+        cjson_u64 word = 0;
+        cjson_u64 quotes = 0;
+        cjson_u64 backslashes = 0;
+        memcpy(&word, input + offset, sizeof(word));
+
+        /* a byte of x is zero iff the corresponding high bit of (x - 0x01..) & ~x is set */
+        quotes = word ^ (ones * '\"');
+        backslashes = word ^ (ones * '\\');
+        if ((((word - (ones * 32)) & ~word)
+            | ((quotes - ones) & ~quotes)
+            | ((backslashes - ones) & ~backslashes)) & highs)
+        {
+            break;
+        }
+    }
+#endif
+
+    for (; offset < length; offset++)
+    {
+        if (escape_length(input[offset]) != 0)
+        {
+            break;
+        }
+    }
+
+    return offset;
+}
+
+/* Render the cstring provided to an escaped version that can be printed. */
+static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffer * const output_buffer)
+{
+    static const char hex_digits[] = "0123456789abcdef";
+    const unsigned char *input_pointer = NULL;
+    const unsigned char *input_end = NULL;
+    unsigned char *output = NULL;
+    unsigned char *output_pointer = NULL;
+    size_t input_length = 0;
+    size_t output_length = 0;
+    size_t run_length = 0;
+    /* numbers of additional characters needed for escaping */
+    size_t escape_characters = 0;
+
+    if (output_buffer == NULL)
+    {
+        return false;
     }
 
     /* empty string */
@@ -946,31 +1672,17 @@ static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffe
         return true;
     }
 
-    /* set "flag" to 1 if something needs to be escaped */
-    for (input_pointer = input; *input_pointer; input_pointer++)
+    input_length = strlen((const char*)input);
+    input_end = input + input_length;
+
+    /* count the characters that need escaping, jumping over the runs in between */
+    for (input_pointer = input + find_escape(input, input_length); input_pointer < input_end; )
     {
-        switch (*input_pointer)
-        {
-            case '\"':
-            case '\\':
-            case '\b':
-            case '\f':
-            case '\n':
-            case '\r':
-            case '\t':
-                /* one character escape sequence */
-                escape_characters++;
-                break;
-            default:
-                if (*input_pointer < 32)
-                {
-                    /* UTF-16 escape sequence uXXXX */
-                    escape_characters += 5;
-                }
-                break;
-        }
+        escape_characters += escape_length(*input_pointer);
+        input_pointer++;
+        input_pointer += find_escape(input_pointer, (size_t)(input_end - input_pointer));
     }
-    output_length = (size_t)(input_pointer - input) + escape_characters;
+    output_length = input_length + escape_characters;
 
     output = ensure(output_buffer, output_length + sizeof("\"\""));
     if (output == NULL)
@@ -991,47 +1703,51 @@ static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffe
 
     output[0] = '\"';
     output_pointer = output + 1;
-    /* copy the string */
-    for (input_pointer = input; *input_pointer != '\0'; (void)input_pointer++, output_pointer++)
-    {
-        if ((*input_pointer > 31) && (*input_pointer != '\"') && (*input_pointer != '\\'))
+    /* copy the string, escape-free runs in one go */
+    for (input_pointer = input; ; input_pointer++)
+    {
+        run_length = find_escape(input_pointer, (size_t)(input_end - input_pointer));
+        memcpy(output_pointer, input_pointer, run_length);
+        output_pointer += run_length;
+        input_pointer += run_length;
+        if (input_pointer >= input_end)
         {
-            /* normal character, copy */
-            *output_pointer = *input_pointer;
+            break;
         }
-        else
+
+        /* character needs to be escaped */
+        *output_pointer++ = '\\';
+        switch (*input_pointer)
         {
-            /* character needs to be escaped */
-            *output_pointer++ = '\\';
-            switch (*input_pointer)
-            {
-                case '\\':
-                    *output_pointer = '\\';
-                    break;
-                case '\"':
-                    *output_pointer = '\"';
-                    break;
-                case '\b':
-                    *output_pointer = 'b';
-                    break;
-                case '\f':
-                    *output_pointer = 'f';
-                    break;
-                case '\n':
-                    *output_pointer = 'n';
-                    break;
-                case '\r':
-                    *output_pointer = 'r';
-                    break;
-                case '\t':
-                    *output_pointer = 't';
-                    break;
-                default:
-                    /* escape and print as unicode codepoint */
-                    sprintf((char*)output_pointer, "u%04x", *input_pointer);
-                    output_pointer += 4;
-                    break;
-            }
+            case '\\':
+                *output_pointer++ = '\\';
+                break;
+            case '\"':
+                *output_pointer++ = '\"';
+                break;
+            case '\b':
+                *output_pointer++ = 'b';
+                break;
+            case '\f':
+                *output_pointer++ = 'f';
+                break;
+            case '\n':
+                *output_pointer++ = 'n';
+                break;
+            case '\r':
+                *output_pointer++ = 'r';
+                break;
+            case '\t':
+                *output_pointer++ = 't';
+                break;
+            default:
+                /* escape and print as unicode codepoint */
+                *output_pointer++ = 'u';
+                *output_pointer++ = '0';
+                *output_pointer++ = '0';
+                *output_pointer++ = (unsigned char)hex_digits[*input_pointer >> 4];
+                *output_pointer++ = (unsigned char)hex_digits[*input_pointer & 0x0F];
+                break;
         }
     }
     output[output_length + 1] = '\"';
@@ -1112,9 +1828,9 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return
 }
 
 /* Parse an object - create a new root, and populate. */
-CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
+static cJSON *parse_with_length(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated, cJSON_bool in_situ)
 {
-    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 } };
+    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 }, 0 };
     cJSON *item = NULL;
 
     /* reset error position */
@@ -1130,6 +1846,7 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer
     buffer.length = buffer_length;
     buffer.offset = 0;
     buffer.hooks = global_hooks;
+    buffer.in_situ = in_situ;
 
     item = cJSON_New_Item(&global_hooks);
     if (item == NULL) /* memory fail */
@@ -1191,6 +1908,21 @@ fail:
     return NULL;
 }
 
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
+{
+    return parse_with_length(value, buffer_length, return_parse_end, require_null_terminated, false);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseInSitu(char *value, size_t buffer_length)
+{
+    return parse_with_length(value, buffer_length, NULL, false, true);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseInSituWithOpts(char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
+{
+    return parse_with_length(value, buffer_length, return_parse_end, require_null_terminated, true);
+}
+
 /* Default options for cJSON_Parse */
 CJSON_PUBLIC(cJSON *) cJSON_Parse(const char *value)
 {
@@ -1203,6 +1935,7 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_len
 }
 
 #define cjson_min(a, b) (((a) < (b)) ? (a) : (b))
+#define cjson_max(a, b) (((a) > (b)) ? (a) : (b))
 
 static unsigned char *print(const cJSON * const item, cJSON_bool format, const internal_hooks * const hooks)
 {
@@ -1284,7 +2017,7 @@ CJSON_PUBLIC(char *) cJSON_PrintUnformatted(const cJSON *item)
 
 CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON_bool fmt)
 {
-    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 }, 0, 0, 0, 0, 0 };
 
     if (prebuffer < 0)
     {
@@ -1313,124 +2046,531 @@ CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON
     return (char*)p.buffer;
 }
 
-CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format)
+CJSON_PUBLIC(cJSON_bool) cJSON_PrintStreamed(const cJSON *item, cJSON_bool format, size_t chunk_size, cJSON_FlushCallback flush, void *context)
 {
-    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 }, 0, 0, 0, 0, 0 };
+    cJSON_bool success = false;
 
-    if ((length < 0) || (buffer == NULL))
+    if ((flush == NULL) || (chunk_size < 2) || (chunk_size > INT_MAX))
     {
         return false;
     }
 
-    p.buffer = (unsigned char*)buffer;
-    p.length = (size_t)length;
-    p.offset = 0;
-    p.noalloc = true;
+    p.buffer = (unsigned char*)global_hooks.allocate(chunk_size);
+    if (p.buffer == NULL)
+    {
+        return false;
+    }
+
+    p.length = chunk_size;
     p.format = format;
     p.hooks = global_hooks;
+    p.flush = flush;
+    p.flush_context = context;
 
-    return print_value(item, &p);
+    if (print_value(item, &p))
+    {
+        update_offset(&p);
+        success = (p.offset == 0) || flush(context, (const char*)p.buffer, p.offset);
+    }
+
+    /* a failed ensure may have freed the buffer already */
+    if (p.buffer != NULL)
+    {
+        global_hooks.deallocate(p.buffer);
+    }
+
+    return success;
 }
 
-/* Parser core - when encountering text, process appropriately. */
-static cJSON_bool parse_value(cJSON * const item, parse_buffer * const input_buffer)
+static cJSON_bool count_bytes(void *context, const char *data, size_t length)
 {
-    if ((input_buffer == NULL) || (input_buffer->content == NULL))
+    (void)data;
+    *(size_t*)context += length;
+
+    return true;
+}
+
+CJSON_PUBLIC(size_t) cJSON_PrintMeasure(const cJSON *item, cJSON_bool format)
+{
+    unsigned char chunk[256];
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 }, 0, 0, 0, 0, 0 };
+    size_t counted = 0;
+    size_t size = 0;
+
+    /* print into a small chunk that is thrown away whenever it fills up, only the sizes are kept */
+    p.buffer = chunk;
+    p.length = sizeof(chunk);
+    p.format = format;
+    p.hooks = global_hooks;
+    p.flush = count_bytes;
+    p.flush_context = &counted;
+    p.borrowed = true;
+
+    if (print_value(item, &p))
     {
-        return false; /* no input */
+        update_offset(&p);
+        size = cjson_max(p.peak, counted + p.offset + 1);
     }
 
-    /* parse the different types of values */
-    /* null */
-    if (can_read(input_buffer, 4) && (strncmp((const char*)buffer_at_offset(input_buffer), "null", 4) == 0))
+    if (!p.borrowed && (p.buffer != NULL))
     {
-        item->type = cJSON_NULL;
-        input_buffer->offset += 4;
-        return true;
+        global_hooks.deallocate(p.buffer);
     }
-    /* false */
-    if (can_read(input_buffer, 5) && (strncmp((const char*)buffer_at_offset(input_buffer), "false", 5) == 0))
+
+    return size;
+}
+
+CJSON_PUBLIC(char *) cJSON_PrintReusable(const cJSON *item, cJSON_bool format, cJSON_PrintBuffer * const reuse, size_t * const length)
+{
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 }, 0, 0, 0, 0, 0 };
+    size_t size = 0;
+    char *bigger = NULL;
+
+    if (reuse == NULL)
     {
-        item->type = cJSON_False;
-        input_buffer->offset += 5;
-        return true;
+        return NULL;
     }
-    /* true */
-    if (can_read(input_buffer, 4) && (strncmp((const char*)buffer_at_offset(input_buffer), "true", 4) == 0))
+
+    p.format = format;
+    p.hooks = global_hooks;
+    p.noalloc = true;
+
+    if (reuse->buffer != NULL)
     {
-        item->type = cJSON_True;
-        item->valueint = 1;
-        input_buffer->offset += 4;
-        return true;
+        p.buffer = (unsigned char*)reuse->buffer;
+        p.length = reuse->size;
+        if (print_value(item, &p))
+        {
+            goto done;
+        }
     }
-    /* string */
-    if (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == '\"'))
+
+    /* it doesn't fit: measure first, so the buffer grows once and the text is written once */
+    size = cJSON_PrintMeasure(item, format);
+    if ((size == 0) || (size > INT_MAX))
     {
-        return parse_string(item, input_buffer);
+        return NULL;
     }
-    /* number */
-    if (can_access_at_index(input_buffer, 0) && ((buffer_at_offset(input_buffer)[0] == '-') || ((buffer_at_offset(input_buffer)[0] >= '0') && (buffer_at_offset(input_buffer)[0] <= '9'))))
+    if (size > reuse->size)
     {
-        return parse_number(item, input_buffer);
+        bigger = (char*)global_hooks.allocate(size);
+        if (bigger == NULL)
+        {
+            return NULL;
+        }
+        if (reuse->buffer != NULL)
+        {
+            global_hooks.deallocate(reuse->buffer);
+        }
+        reuse->buffer = bigger;
+        reuse->size = size;
     }
-    /* array */
-    if (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == '['))
+
+    p.buffer = (unsigned char*)reuse->buffer;
+    p.length = reuse->size;
+    p.offset = 0;
+    p.depth = 0;
+    if (!print_value(item, &p))
     {
-        return parse_array(item, input_buffer);
+        return NULL;
     }
-    /* object */
-    if (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == '{'))
+
+done:
+    update_offset(&p);
+    if (length != NULL)
     {
-        return parse_object(item, input_buffer);
+        *length = p.offset;
     }
 
-    return false;
+    return reuse->buffer;
 }
 
-/* Render a value to text. */
-static cJSON_bool print_value(const cJSON * const item, printbuffer * const output_buffer)
+CJSON_PUBLIC(void) cJSON_FreePrintBuffer(cJSON_PrintBuffer * const reuse)
 {
-    unsigned char *output = NULL;
+    if ((reuse == NULL) || (reuse->buffer == NULL))
+    {
+        return;
+    }
 
-    if ((item == NULL) || (output_buffer == NULL))
+    global_hooks.deallocate(reuse->buffer);
+    reuse->buffer = NULL;
+    reuse->size = 0;
+}
+
+struct cJSON_Template
+{
+    unsigned char *text; /* the skeleton without the slot markers */
+    size_t length;
+    size_t *slots; /* offset into text of every slot, in order */
+    unsigned char *raw; /* for every slot: 1 if it was '@' (the value is copied verbatim) */
+    size_t slot_count;
+    internal_hooks hooks;
+};
+
+CJSON_PUBLIC(cJSON_Template *) cJSON_CreateTemplate(const char *skeleton)
+{
+    cJSON_Template *tmpl = NULL;
+    const unsigned char *input = (const unsigned char*)skeleton;
+    size_t length = 0;
+    size_t position = 0;
+    size_t slot_count = 0;
+    cJSON_bool in_string = false;
+    cJSON_bool escaped = false;
+
+    if (skeleton == NULL)
     {
-        return false;
+        return NULL;
     }
 
-    switch ((item->type) & 0xFF)
+    /* count the slots and check that every string literal is closed */
+    length = strlen(skeleton);
+    for (position = 0; position < length; position++)
     {
-        case cJSON_NULL:
-            output = ensure(output_buffer, 5);
-            if (output == NULL)
+        if (in_string)
+        {
+            if (escaped)
             {
-                return false;
+                escaped = false;
             }
-            strcpy((char*)output, "null");
-            return true;
-
-        case cJSON_False:
-            output = ensure(output_buffer, 6);
-            if (output == NULL)
+            else if (input[position] == '\\')
             {
-                return false;
+                escaped = true;
             }
-            strcpy((char*)output, "false");
-            return true;
-
-        case cJSON_True:
-            output = ensure(output_buffer, 5);
-            if (output == NULL)
+            else if (input[position] == '\"')
             {
-                return false;
+                in_string = false;
             }
-            strcpy((char*)output, "true");
-            return true;
+        }
+        else if (input[position] == '\"')
+        {
+            in_string = true;
+        }
+        else if ((input[position] == '$') || (input[position] == '@'))
+        {
+            slot_count++;
+        }
+    }
+    if (in_string)
+    {
+        return NULL;
+    }
 
-        case cJSON_Number:
-            return print_number(item, output_buffer);
+    tmpl = (cJSON_Template*)global_hooks.allocate(sizeof(cJSON_Template));
+    if (tmpl == NULL)
+    {
+        return NULL;
+    }
+    memset(tmpl, '\0', sizeof(cJSON_Template));
+    tmpl->hooks = global_hooks;
 
-        case cJSON_Raw:
-        {
+    tmpl->text = (unsigned char*)tmpl->hooks.allocate(length - slot_count + 1);
+    if (tmpl->text == NULL)
+    {
+        goto fail;
+    }
+    if (slot_count > 0)
+    {
+        tmpl->slots = (size_t*)tmpl->hooks.allocate(slot_count * sizeof(size_t));
+        tmpl->raw = (unsigned char*)tmpl->hooks.allocate(slot_count);
+        if ((tmpl->slots == NULL) || (tmpl->raw == NULL))
+        {
+            goto fail;
+        }
+    }
+
+    for (position = 0; position < length; position++)
+    {
+        if (in_string)
+        {
+            if (escaped)
+            {
+                escaped = false;
+            }
+            else if (input[position] == '\\')
+            {
+                escaped = true;
+            }
+            else if (input[position] == '\"')
+            {
+                in_string = false;
+            }
+        }
+        else if (input[position] == '\"')
+        {
+            in_string = true;
+        }
+        else if ((input[position] == '$') || (input[position] == '@'))
+        {
+            tmpl->raw[tmpl->slot_count] = (unsigned char)(input[position] == '@');
+            tmpl->slots[tmpl->slot_count++] = tmpl->length;
+            continue;
+        }
+        tmpl->text[tmpl->length++] = input[position];
+    }
+    tmpl->text[tmpl->length] = '\0';
+
+    return tmpl;
+
+fail:
+    cJSON_DeleteTemplate(tmpl);
+
+    return NULL;
+}
+
+CJSON_PUBLIC(void) cJSON_DeleteTemplate(cJSON_Template *tmpl)
+{
+    if (tmpl == NULL)
+    {
+        return;
+    }
+
+    if (tmpl->text != NULL)
+    {
+        tmpl->hooks.deallocate(tmpl->text);
+    }
+    if (tmpl->slots != NULL)
+    {
+        tmpl->hooks.deallocate(tmpl->slots);
+    }
+    if (tmpl->raw != NULL)
+    {
+        tmpl->hooks.deallocate(tmpl->raw);
+    }
+    tmpl->hooks.deallocate(tmpl);
+}
+
+CJSON_PUBLIC(size_t) cJSON_TemplateSlotCount(const cJSON_Template *tmpl)
+{
+    if (tmpl == NULL)
+    {
+        return 0;
+    }
+
+    return tmpl->slot_count;
+}
+
+/* copy a constant piece of the skeleton */
+static cJSON_bool print_raw(const unsigned char * const raw, size_t length, printbuffer * const output_buffer)
+{
+    unsigned char *output = ensure(output_buffer, length);
+    if (output == NULL)
+    {
+        return false;
+    }
+    memcpy(output, raw, length);
+    output_buffer->offset += length;
+
+    return true;
+}
+
+CJSON_PUBLIC(char *) cJSON_TemplateFill(const cJSON_Template *tmpl, const char * const *values, cJSON_PrintBuffer * const reuse, size_t * const length)
+{
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 }, 0, 0, 0, 0, 0 };
+    size_t segment = 0;
+    size_t slot = 0;
+
+    if ((tmpl == NULL) || (reuse == NULL) || ((values == NULL) && (tmpl->slot_count > 0)))
+    {
+        return NULL;
+    }
+
+    if (reuse->buffer == NULL)
+    {
+        /* first use: room for the skeleton and some short values */
+        reuse->size = tmpl->length + 256;
+        reuse->buffer = (char*)global_hooks.allocate(reuse->size);
+        if (reuse->buffer == NULL)
+        {
+            reuse->size = 0;
+            return NULL;
+        }
+    }
+
+    /* the caller keeps owning reuse->buffer; if it doesn't fit, ensure moves to a bigger copy */
+    p.buffer = (unsigned char*)reuse->buffer;
+    p.length = reuse->size;
+    p.hooks = global_hooks;
+    p.borrowed = true;
+
+    for (slot = 0; slot < tmpl->slot_count; slot++)
+    {
+        if (!print_raw(tmpl->text + segment, tmpl->slots[slot] - segment, &p))
+        {
+            goto fail;
+        }
+        segment = tmpl->slots[slot];
+
+        if (values[slot] == NULL)
+        {
+            if (!print_raw((const unsigned char*)"null", 4, &p))
+            {
+                goto fail;
+            }
+        }
+        else if (tmpl->raw[slot])
+        {
+            if (!print_raw((const unsigned char*)values[slot], strlen(values[slot]), &p))
+            {
+                goto fail;
+            }
+        }
+        else
+        {
+            if (!print_string_ptr((const unsigned char*)values[slot], &p))
+            {
+                goto fail;
+            }
+            update_offset(&p);
+        }
+    }
+    if (!print_raw(tmpl->text + segment, tmpl->length - segment, &p))
+    {
+        goto fail;
+    }
+    p.buffer[p.offset] = '\0';
+
+    if (!p.borrowed)
+    {
+        /* it grew: keep the bigger buffer for the next fill */
+        global_hooks.deallocate(reuse->buffer);
+        reuse->buffer = (char*)p.buffer;
+        reuse->size = p.length;
+    }
+    if (length != NULL)
+    {
+        *length = p.offset;
+    }
+
+    return reuse->buffer;
+
+fail:
+    if (!p.borrowed && (p.buffer != NULL))
+    {
+        global_hooks.deallocate(p.buffer);
+    }
+
+    return NULL;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format)
+{
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 }, 0, 0, 0, 0, 0 };
+
+    if ((length < 0) || (buffer == NULL))
+    {
+        return false;
+    }
+
+    p.buffer = (unsigned char*)buffer;
+    p.length = (size_t)length;
+    p.offset = 0;
+    p.noalloc = true;
+    p.format = format;
+    p.hooks = global_hooks;
+
+    return print_value(item, &p);
+}
+
+/* Parser core - when encountering text, process appropriately. */
+static cJSON_bool parse_value(cJSON * const item, parse_buffer * const input_buffer)
+{
+    if ((input_buffer == NULL) || (input_buffer->content == NULL))
+    {
+        return false; /* no input */
+    }
+
+    /* parse the different types of values */
+    /* null */
+    if (can_read(input_buffer, 4) && (strncmp((const char*)buffer_at_offset(input_buffer), "null", 4) == 0))
+    {
+        item->type = cJSON_NULL;
+        input_buffer->offset += 4;
+        return true;
+    }
+    /* false */
+    if (can_read(input_buffer, 5) && (strncmp((const char*)buffer_at_offset(input_buffer), "false", 5) == 0))
+    {
+        item->type = cJSON_False;
+        input_buffer->offset += 5;
+        return true;
+    }
+    /* true */
+    if (can_read(input_buffer, 4) && (strncmp((const char*)buffer_at_offset(input_buffer), "true", 4) == 0))
+    {
+        item->type = cJSON_True;
+        item->valueint = 1;
+        input_buffer->offset += 4;
+        return true;
+    }
+    /* string */
+    if (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == '\"'))
+    {
+        return parse_string(item, input_buffer);
+    }
+    /* number */
+    if (can_access_at_index(input_buffer, 0) && ((buffer_at_offset(input_buffer)[0] == '-') || ((buffer_at_offset(input_buffer)[0] >= '0') && (buffer_at_offset(input_buffer)[0] <= '9'))))
+    {
+        return parse_number(item, input_buffer);
+    }
+    /* array */
+    if (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == '['))
+    {
+        return parse_array(item, input_buffer);
+    }
+    /* object */
+    if (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == '{'))
+    {
+        return parse_object(item, input_buffer);
+    }
+
+    return false;
+}
+
+/* Render a value to text. */
+static cJSON_bool print_value(const cJSON * const item, printbuffer * const output_buffer)
+{
+    unsigned char *output = NULL;
+
+    if ((item == NULL) || (output_buffer == NULL))
+    {
+        return false;
+    }
+
+    switch ((item->type) & 0xFF)
+    {
+        case cJSON_NULL:
+            output = ensure(output_buffer, 5);
+            if (output == NULL)
+            {
+                return false;
+            }
+            strcpy((char*)output, "null");
+            return true;
+
+        case cJSON_False:
+            output = ensure(output_buffer, 6);
+            if (output == NULL)
+            {
+                return false;
+            }
+            strcpy((char*)output, "false");
+            return true;
+
+        case cJSON_True:
+            output = ensure(output_buffer, 5);
+            if (output == NULL)
+            {
+                return false;
+            }
+            strcpy((char*)output, "true");
+            return true;
+
+        case cJSON_Number:
+            return print_number(item, output_buffer);
+
+        case cJSON_Raw:
+        {
             size_t raw_length = 0;
             if (item->valuestring == NULL)
             {
@@ -1695,6 +2835,11 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
         /* swap valuestring and string, because we parsed the name */
         current_item->string = current_item->valuestring;
         current_item->valuestring = NULL;
+        if (input_buffer->in_situ)
+        {
+            /* the key belongs to the caller's buffer */
+            current_item->type = cJSON_StringIsConst;
+        }
 
         if (cannot_access_at_index(input_buffer, 0) || (buffer_at_offset(input_buffer)[0] != ':'))
         {
@@ -1708,6 +2853,10 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
         {
             goto fail; /* failed to parse value */
         }
+        if (input_buffer->in_situ)
+        {
+            current_item->type |= cJSON_StringIsConst;
+        }
         buffer_skip_whitespace(input_buffer);
     }
     while (can_access_at_index(input_buffer, 0) && (buffer_at_offset(input_buffer)[0] == ','));
@@ -1853,6 +3002,1262 @@ static cJSON_bool print_object(const cJSON * const item, printbuffer * const out
     return true;
 }
 
+/* Stream framing: the input arrives in arbitrary chunks (e.g. recv() calls) and every byte is looked at once.
+ * Only strings and brackets are followed, enough to tell where each document ends. */
+typedef enum
+{
+    stream_expect_value, /* outside a string: before a document or inside its brackets */
+    stream_in_string
+} stream_state;
+
+struct cJSON_Stream
+{
+    stream_state state;
+    size_t depth; /* open arrays and objects */
+    cJSON_bool escaped; /* the last string byte seen was an unescaped backslash */
+    cJSON_bool failed;
+    internal_hooks hooks;
+};
+
+/* forget the document in progress */
+static void stream_discard(cJSON_Stream * const stream)
+{
+    stream->depth = 0;
+    stream->escaped = false;
+    stream->state = stream_expect_value;
+}
+
+static cJSON_bool stream_fail(cJSON_Stream * const stream)
+{
+    stream_discard(stream);
+    stream->failed = true;
+
+    return false;
+}
+
+/* grow a buffer to hold at least needed bytes */
+static void *grow_buffer(const internal_hooks * const hooks, void *buffer, size_t * const size, const size_t needed)
+{
+    size_t new_size = (*size == 0) ? 64 : *size;
+    void *new_buffer = NULL;
+
+    if (needed <= *size)
+    {
+        return buffer;
+    }
+    while (new_size < needed)
+    {
+        if (new_size > (((size_t)-1) / 2))
+        {
+            return NULL;
+        }
+        new_size *= 2;
+    }
+
+    if (hooks->reallocate != NULL)
+    {
+        new_buffer = hooks->reallocate(buffer, new_size);
+    }
+    else
+    {
+        new_buffer = hooks->allocate(new_size);
+        if ((new_buffer != NULL) && (buffer != NULL))
+        {
+            memcpy(new_buffer, buffer, *size);
+            hooks->deallocate(buffer);
+        }
+    }
+    if (new_buffer != NULL)
+    {
+        *size = new_size;
+    }
+
+    return new_buffer;
+}
+
+/* index of the closing quote of a string body, or length if the string goes on in the next chunk */
+static size_t stream_find_string_end(const unsigned char * const input, const size_t length, cJSON_bool * const escaped)
+{
+    size_t i = 0;
+
+    while (i < length)
+    {
+        if (*escaped)
+        {
+            *escaped = false;
+            i++;
+            continue;
+        }
+
+        /* jump over the plain characters */
+        i += find_escape(input + i, length - i);
+        if (i >= length)
+        {
+            break;
+        }
+        if (input[i] == '\"')
+        {
+            return i;
+        }
+        if (input[i] == '\\')
+        {
+            *escaped = true;
+        }
+        i++;
+    }
+
+    return length;
+}
+
+CJSON_PUBLIC(cJSON_Stream *) cJSON_CreateStream(void)
+{
+    cJSON_Stream *stream = (cJSON_Stream*)global_hooks.allocate(sizeof(cJSON_Stream));
+    if (stream == NULL)
+    {
+        return NULL;
+    }
+
+    memset(stream, '\0', sizeof(cJSON_Stream));
+    stream->state = stream_expect_value;
+    stream->hooks = global_hooks;
+
+    return stream;
+}
+
+CJSON_PUBLIC(void) cJSON_DeleteStream(cJSON_Stream *stream)
+{
+    if (stream == NULL)
+    {
+        return;
+    }
+
+    stream->hooks.deallocate(stream);
+}
+
+CJSON_PUBLIC(void) cJSON_StreamReset(cJSON_Stream * const stream)
+{
+    if (stream == NULL)
+    {
+        return;
+    }
+
+    stream_discard(stream);
+    stream->failed = false;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_StreamIsIdle(const cJSON_Stream * const stream)
+{
+    return (stream != NULL) && !stream->failed && (stream->depth == 0) && (stream->state == stream_expect_value);
+}
+
+/* Framing only: follows strings and brackets to find where each document ends, without building or validating it.
+ * Between documents only whitespace may come before the '{' or '[' that opens the next one; a scalar there would
+ * leave nothing to resynchronize on (a stray quote would shift every later string), so it is an error right away. */
+CJSON_PUBLIC(cJSON_bool) cJSON_StreamScan(cJSON_Stream * const stream, const char *chunk, size_t length, size_t *consumed, cJSON_bool *complete)
+{
+    const unsigned char *input = (const unsigned char*)chunk;
+    cJSON_bool done = false;
+    size_t position = 0;
+
+    if (consumed != NULL)
+    {
+        *consumed = 0;
+    }
+    if (complete != NULL)
+    {
+        *complete = false;
+    }
+    if ((stream == NULL) || stream->failed || ((input == NULL) && (length > 0)))
+    {
+        return false;
+    }
+
+    while ((position < length) && !done)
+    {
+        const unsigned char character = input[position];
+
+        if (stream->state == stream_in_string)
+        {
+            size_t end = stream_find_string_end(input + position, length - position, &stream->escaped);
+            if (end == (length - position))
+            {
+                position = length;
+                break;
+            }
+            position += end + 1;
+            stream->state = stream_expect_value;
+            continue;
+        }
+
+        position++;
+        if ((stream->depth == 0) && (character != '{') && (character != '['))
+        {
+            if ((character != ' ') && (character != '\t') && (character != '\n') && (character != '\r'))
+            {
+                return stream_fail(stream);
+            }
+            continue;
+        }
+        switch (character)
+        {
+            case '\"':
+                stream->state = stream_in_string;
+                stream->escaped = false;
+                break;
+
+            case '{':
+            case '[':
+                if (stream->depth >= CJSON_NESTING_LIMIT)
+                {
+                    return stream_fail(stream);
+                }
+                stream->depth++;
+                break;
+
+            case '}':
+            case ']':
+                stream->depth--;
+                done = (stream->depth == 0);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    if (consumed != NULL)
+    {
+        *consumed = position;
+    }
+    if (complete != NULL)
+    {
+        *complete = done;
+    }
+
+    return true;
+}
+
+/* Validation: checks that the text is exactly one JSON value (RFC 8259 grammar, strict numbers, no control
+ * characters in strings, escapes that cJSON can decode) and that it is valid UTF-8, without building anything.
+ * String contents, where almost all of the bytes are, are skipped in blocks: SSE2 or the word-at-a-time test
+ * classifies 16 (8) bytes at once and only quotes, backslashes, control characters and non-ASCII bytes stop it. */
+
+/* Find the first byte in a string that needs a closer look: '\"', '\\', a control character or a non-ASCII byte. */
+static size_t find_string_special(const unsigned char * const input, const size_t length)
+{
+    size_t offset = 0;
+
+#ifdef CJSON_USE_SSE2
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i first_printable = _mm_set1_epi8(32);
+
+    for (; (offset + 16) <= length; offset += 16)
+    {
+        const __m128i block = _mm_loadu_si128((const __m128i*)(const void*)(input + offset));
+        /* as signed bytes, the non-ASCII ones are negative, so one compare catches them and the control characters */
+        __m128i special = _mm_cmplt_epi8(block, first_printable);
+        unsigned int mask = 0;
+
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(block, quote));
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(block, backslash));
+        mask = (unsigned int)_mm_movemask_epi8(special);
+        if (mask != 0)
+        {
+            return offset + lowest_set_bit(mask);
+        }
+    }
+#else
+    const cjson_u64 ones = CJSON_U64(0x0101010101010101);
+    const cjson_u64 highs = CJSON_U64(0x8080808080808080);
+
+    for (; (offset + 8) <= length; offset += 8)
+    {
+        cjson_u64 word = 0;
+        cjson_u64 quotes = 0;
+        cjson_u64 backslashes = 0;
+        memcpy(&word, input + offset, sizeof(word));
+
+        quotes = word ^ (ones * '\"');
+        backslashes = word ^ (ones * '\\');
+        if ((word
+            | ((word - (ones * 32)) & ~word)
+            | ((quotes - ones) & ~quotes)
+            | ((backslashes - ones) & ~backslashes)) & highs)
+        {
+            break;
+        }
+    }
+#endif
+
+    for (; offset < length; offset++)
+    {
+        if ((input[offset] < 32) || (input[offset] >= 128) || (input[offset] == '\"') || (input[offset] == '\\'))
+        {
+            break;
+        }
+    }
+
+    return offset;
+}
+
+/* length of the escape sequence at input (2, 6 or 12 bytes), 0 if it isn't one that cJSON decodes */
+static unsigned char validate_escape(const unsigned char * const input, const unsigned char * const input_end)
+{
+    unsigned char utf8[4];
+    unsigned char *output_pointer = utf8;
+    size_t i = 0;
+
+    if ((input_end - input) < 2)
+    {
+        return 0;
+    }
+
+    switch (input[1])
+    {
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+        case '\"':
+        case '\\':
+        case '/':
+            return 2;
+
+        case 'u':
+            /* parse_hex4 reads invalid digits as 0, check them first */
+            if ((input_end - input) < 6)
+            {
+                return 0;
+            }
+            for (i = 2; i < 6; i++)
+            {
+                if (!isxdigit(input[i]))
+                {
+                    return 0;
+                }
+            }
+            return utf16_literal_to_utf8(input, input_end, &output_pointer);
+
+        default:
+            return 0;
+    }
+}
+
+/* length of the UTF-8 sequence that starts with a non-ASCII byte at input, 0 if it is invalid, overlong, a
+ * surrogate or beyond U+10FFFF */
+static size_t validate_utf8(const unsigned char * const input, const size_t length)
+{
+    size_t sequence_length = 0;
+    size_t i = 0;
+    unsigned char second_low = 0x80;
+    unsigned char second_high = 0xBF;
+
+    if (input[0] < 0xC2)
+    {
+        return 0;
+    }
+    else if (input[0] < 0xE0)
+    {
+        sequence_length = 2;
+    }
+    else if (input[0] < 0xF0)
+    {
+        sequence_length = 3;
+        if (input[0] == 0xE0)
+        {
+            second_low = 0xA0;
+        }
+        else if (input[0] == 0xED)
+        {
+            second_high = 0x9F;
+        }
+    }
+    else if (input[0] < 0xF5)
+    {
+        sequence_length = 4;
+        if (input[0] == 0xF0)
+        {
+            second_low = 0x90;
+        }
+        else if (input[0] == 0xF4)
+        {
+            second_high = 0x8F;
+        }
+    }
+    else
+    {
+        return 0;
+    }
+
+    if ((length < sequence_length) || (input[1] < second_low) || (input[1] > second_high))
+    {
+        return 0;
+    }
+    for (i = 2; i < sequence_length; i++)
+    {
+        if ((input[i] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+    }
+
+    return sequence_length;
+}
+
+static size_t validate_whitespace(const unsigned char * const input, const size_t length, size_t offset)
+{
+    while ((offset < length) && ((input[offset] == ' ') || (input[offset] == '\t') || (input[offset] == '\n') || (input[offset] == '\r')))
+    {
+        offset++;
+    }
+
+    return offset;
+}
+
+/* offset after the string that starts at offset, 0 if it is invalid */
+static size_t validate_string(const unsigned char * const input, const size_t length, size_t offset)
+{
+    size_t sequence_length = 0;
+
+    offset++;
+    while (offset < length)
+    {
+        offset += find_string_special(input + offset, length - offset);
+        if (offset >= length)
+        {
+            break;
+        }
+
+        if (input[offset] == '\"')
+        {
+            return offset + 1;
+        }
+        if (input[offset] == '\\')
+        {
+            sequence_length = validate_escape(input + offset, input + length);
+        }
+        else if (input[offset] >= 128)
+        {
+            sequence_length = validate_utf8(input + offset, length - offset);
+        }
+        else
+        {
+            /* control character */
+            return 0;
+        }
+        if (sequence_length == 0)
+        {
+            return 0;
+        }
+        offset += sequence_length;
+    }
+
+    return 0;
+}
+
+static size_t validate_digits(const unsigned char * const input, const size_t length, size_t offset)
+{
+    while ((offset < length) && (input[offset] >= '0') && (input[offset] <= '9'))
+    {
+        offset++;
+    }
+
+    return offset;
+}
+
+/* offset after the number that starts at offset, 0 if it is invalid */
+static size_t validate_number(const unsigned char * const input, const size_t length, size_t offset)
+{
+    size_t digits = 0;
+
+    if (input[offset] == '-')
+    {
+        offset++;
+    }
+    if ((offset < length) && (input[offset] == '0'))
+    {
+        offset++;
+    }
+    else
+    {
+        digits = validate_digits(input, length, offset);
+        if ((digits == offset) || (input[offset] == '0'))
+        {
+            return 0;
+        }
+        offset = digits;
+    }
+
+    if ((offset < length) && (input[offset] == '.'))
+    {
+        digits = validate_digits(input, length, offset + 1);
+        if (digits == (offset + 1))
+        {
+            return 0;
+        }
+        offset = digits;
+    }
+
+    if ((offset < length) && ((input[offset] == 'e') || (input[offset] == 'E')))
+    {
+        offset++;
+        if ((offset < length) && ((input[offset] == '+') || (input[offset] == '-')))
+        {
+            offset++;
+        }
+        digits = validate_digits(input, length, offset);
+        if (digits == offset)
+        {
+            return 0;
+        }
+        offset = digits;
+    }
+
+    return offset;
+}
+
+/* offset after the string, number or literal that starts at offset, 0 if it is invalid */
+static size_t validate_scalar(const unsigned char * const input, const size_t length, const size_t offset)
+{
+    const char *literal = NULL;
+    size_t literal_length = 0;
+
+    switch (input[offset])
+    {
+        case '\"':
+            return validate_string(input, length, offset);
+
+        case 't':
+            literal = "true";
+            break;
+
+        case 'f':
+            literal = "false";
+            break;
+
+        case 'n':
+            literal = "null";
+            break;
+
+        default:
+            return validate_number(input, length, offset);
+    }
+
+    literal_length = strlen(literal);
+    if (((length - offset) < literal_length) || (memcmp(input + offset, literal, literal_length) != 0))
+    {
+        return 0;
+    }
+
+    return offset + literal_length;
+}
+
+/* an object member's key and its ':', returns the offset of the value, 0 if it is invalid */
+static size_t validate_key(const unsigned char * const input, const size_t length, size_t offset)
+{
+    if ((offset >= length) || (input[offset] != '\"'))
+    {
+        return 0;
+    }
+    offset = validate_string(input, length, offset);
+    if (offset == 0)
+    {
+        return 0;
+    }
+    offset = validate_whitespace(input, length, offset);
+    if ((offset >= length) || (input[offset] != ':'))
+    {
+        return 0;
+    }
+
+    return validate_whitespace(input, length, offset + 1);
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_Validate(const char *json, size_t length)
+{
+    const unsigned char *input = (const unsigned char*)json;
+    /* one bit per open container, set for objects */
+    unsigned char objects[(CJSON_NESTING_LIMIT + 7) / 8];
+    size_t depth = 0;
+    size_t offset = 0;
+    cJSON_bool in_object = false;
+
+    if (json == NULL)
+    {
+        return false;
+    }
+
+    offset = validate_whitespace(input, length, 0);
+    while (true)
+    {
+        /* a value starts at offset */
+        if (offset >= length)
+        {
+            return false;
+        }
+
+        if ((input[offset] == '{') || (input[offset] == '['))
+        {
+            if (depth >= CJSON_NESTING_LIMIT)
+            {
+                return false;
+            }
+            in_object = (input[offset] == '{');
+            if (in_object)
+            {
+                objects[depth / 8] = (unsigned char)(objects[depth / 8] | (1U << (depth % 8)));
+            }
+            else
+            {
+                objects[depth / 8] = (unsigned char)(objects[depth / 8] & ~(1U << (depth % 8)));
+            }
+            depth++;
+
+            offset = validate_whitespace(input, length, offset + 1);
+            if ((offset < length) && (input[offset] == (in_object ? '}' : ']')))
+            {
+                /* empty, handled below like any other value that just ended */
+                depth--;
+                offset++;
+            }
+            else if (in_object)
+            {
+                offset = validate_key(input, length, offset);
+                if (offset == 0)
+                {
+                    return false;
+                }
+                continue;
+            }
+            else
+            {
+                continue;
+            }
+        }
+        else
+        {
+            offset = validate_scalar(input, length, offset);
+            if (offset == 0)
+            {
+                return false;
+            }
+        }
+
+        /* after a value: close the containers that end here, then expect the next element */
+        while (true)
+        {
+            offset = validate_whitespace(input, length, offset);
+            if (depth == 0)
+            {
+                return offset == length;
+            }
+            if (offset >= length)
+            {
+                return false;
+            }
+
+            in_object = ((objects[(depth - 1) / 8] >> ((depth - 1) % 8)) & 1) != 0;
+            if (input[offset] == ',')
+            {
+                break;
+            }
+            if (input[offset] != (in_object ? '}' : ']'))
+            {
+                return false;
+            }
+            depth--;
+            offset++;
+        }
+
+        offset = validate_whitespace(input, length, offset + 1);
+        if (in_object)
+        {
+            offset = validate_key(input, length, offset);
+            if (offset == 0)
+            {
+                return false;
+            }
+        }
+    }
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_ValidateUTF8(const char *text, size_t length)
+{
+    const unsigned char *input = (const unsigned char*)text;
+    size_t offset = 0;
+    size_t sequence_length = 0;
+
+    if (text == NULL)
+    {
+        return false;
+    }
+
+    while (true)
+    {
+        /* quotes, backslashes and control characters also stop the search, they are plain ASCII here */
+        offset += find_string_special(input + offset, length - offset);
+        if (offset >= length)
+        {
+            return true;
+        }
+        if (input[offset] < 128)
+        {
+            offset++;
+            continue;
+        }
+        sequence_length = validate_utf8(input + offset, length - offset);
+        if (sequence_length == 0)
+        {
+            return false;
+        }
+        offset += sequence_length;
+    }
+}
+
+/* On demand access: one pass records where every bracket, string, scalar, ':' and ',' starts, so cursors can jump
+ * over whole values without parsing them. Only the values that are asked for are turned into cJSON items. */
+typedef struct
+{
+    size_t position; /* offset of the first byte */
+    size_t end; /* arrays and objects: index of the closing token, anything else: offset after the last byte */
+} index_token;
+
+struct cJSON_Index
+{
+    const unsigned char *json;
+    index_token *tokens;
+    size_t count;
+    size_t tokens_size; /* in bytes */
+    size_t *open; /* open arrays and objects while building, innermost last */
+    size_t open_size; /* in bytes */
+    internal_hooks hooks;
+};
+
+#define is_structural(character) (((character) == '{') || ((character) == '}') || ((character) == '[') || ((character) == ']') || ((character) == ':') || ((character) == ','))
+
+static cJSON_bool index_push(cJSON_Index * const index, const size_t position, const size_t end)
+{
+    index_token *tokens = (index_token*)grow_buffer(&index->hooks, index->tokens, &index->tokens_size, (index->count + 1) * sizeof(index_token));
+    if (tokens == NULL)
+    {
+        return false;
+    }
+    index->tokens = tokens;
+
+    tokens[index->count].position = position;
+    tokens[index->count].end = end;
+    index->count++;
+
+    return true;
+}
+
+static cJSON_bool index_is_container(const cJSON_Index * const index, const size_t token)
+{
+    const unsigned char first = index->json[index->tokens[token].position];
+
+    return (first == '{') || (first == '[');
+}
+
+/* offset just after the value that starts at token */
+static size_t index_value_end(const cJSON_Index * const index, const size_t token)
+{
+    if (index_is_container(index, token))
+    {
+        return index->tokens[index->tokens[token].end].position + 1;
+    }
+
+    return index->tokens[token].end;
+}
+
+/* the token after the value that starts at token */
+static size_t index_skip_value(const cJSON_Index * const index, const size_t token)
+{
+    if (index_is_container(index, token))
+    {
+        return index->tokens[token].end + 1;
+    }
+
+    return token + 1;
+}
+
+/* compare the string at token with a C string without unescaping it, unless it contains escapes */
+static cJSON_bool index_string_equals(const cJSON_Index * const index, const size_t token, const char * const string, const cJSON_bool case_sensitive)
+{
+    const unsigned char *content = index->json + index->tokens[token].position + 1;
+    const size_t length = index->tokens[token].end - index->tokens[token].position - 2;
+    cJSON *unescaped = NULL;
+    cJSON_bool equal = false;
+    size_t i = 0;
+
+    if (memchr(content, '\\', length) == NULL)
+    {
+        for (i = 0; i < length; i++)
+        {
+            if (string[i] == '\0')
+            {
+                return false;
+            }
+            if (case_sensitive ? (content[i] != (unsigned char)string[i]) : (tolower(content[i]) != tolower((unsigned char)string[i])))
+            {
+                return false;
+            }
+        }
+
+        return string[length] == '\0';
+    }
+
+    unescaped = parse_with_length((const char*)content - 1, length + 2, NULL, false, false);
+    if (cJSON_IsString(unescaped))
+    {
+        if (case_sensitive)
+        {
+            equal = (strcmp(unescaped->valuestring, string) == 0);
+        }
+        else
+        {
+            equal = (case_insensitive_strcmp((const unsigned char*)unescaped->valuestring, (const unsigned char*)string) == 0);
+        }
+    }
+    cJSON_Delete(unescaped);
+
+    return equal;
+}
+
+static cJSON_bool cursor_is_valid(const cJSON_Cursor * const cursor)
+{
+    return (cursor != NULL) && (cursor->index != NULL) && (cursor->token < cursor->index->count);
+}
+
+CJSON_PUBLIC(cJSON_Index *) cJSON_CreateIndex(void)
+{
+    cJSON_Index *index = (cJSON_Index*)global_hooks.allocate(sizeof(cJSON_Index));
+    if (index == NULL)
+    {
+        return NULL;
+    }
+
+    memset(index, '\0', sizeof(cJSON_Index));
+    index->hooks = global_hooks;
+
+    return index;
+}
+
+CJSON_PUBLIC(void) cJSON_DeleteIndex(cJSON_Index *index)
+{
+    if (index == NULL)
+    {
+        return;
+    }
+
+    if (index->tokens != NULL)
+    {
+        index->hooks.deallocate(index->tokens);
+    }
+    if (index->open != NULL)
+    {
+        index->hooks.deallocate(index->open);
+    }
+    index->hooks.deallocate(index);
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_IndexBuild(cJSON_Index * const index, const char *json, size_t length, cJSON_Cursor * const root)
+{
+    const unsigned char *input = (const unsigned char*)json;
+    size_t position = 0;
+    size_t depth = 0;
+    size_t end = 0;
+    size_t start = 0;
+    size_t opener = 0;
+    cJSON_bool escaped = false;
+
+    if (root != NULL)
+    {
+        root->index = index;
+        root->token = 0;
+    }
+    if ((index == NULL) || ((input == NULL) && (length > 0)))
+    {
+        return false;
+    }
+    index->json = input;
+    index->count = 0;
+
+    while (position < length)
+    {
+        const unsigned char character = input[position];
+
+        if (character <= 32)
+        {
+            position++;
+            continue;
+        }
+        if ((depth == 0) && (index->count > 0))
+        {
+            /* more than one value at the top */
+            goto fail;
+        }
+
+        switch (character)
+        {
+            case '{':
+            case '[':
+            {
+                size_t *open = NULL;
+                if (depth >= CJSON_NESTING_LIMIT)
+                {
+                    goto fail;
+                }
+                open = (size_t*)grow_buffer(&index->hooks, index->open, &index->open_size, (depth + 1) * sizeof(size_t));
+                if (open == NULL)
+                {
+                    goto fail;
+                }
+                index->open = open;
+                open[depth++] = index->count;
+                if (!index_push(index, position, 0))
+                {
+                    goto fail;
+                }
+                position++;
+                break;
+            }
+
+            case '}':
+            case ']':
+                if (depth == 0)
+                {
+                    goto fail;
+                }
+                opener = index->open[--depth];
+                if (input[index->tokens[opener].position] != ((character == '}') ? '{' : '['))
+                {
+                    goto fail;
+                }
+                index->tokens[opener].end = index->count;
+                if (!index_push(index, position, position + 1))
+                {
+                    goto fail;
+                }
+                position++;
+                break;
+
+            case ':':
+            case ',':
+                if (!index_push(index, position, position + 1))
+                {
+                    goto fail;
+                }
+                position++;
+                break;
+
+            case '\"':
+                escaped = false;
+                end = stream_find_string_end(input + position + 1, length - position - 1, &escaped);
+                if (end == (length - position - 1))
+                {
+                    /* unterminated string */
+                    goto fail;
+                }
+                if (!index_push(index, position, position + end + 2))
+                {
+                    goto fail;
+                }
+                position += end + 2;
+                break;
+
+            default:
+                /* numbers and literals are only checked when they are parsed */
+                start = position;
+                while ((position < length) && (input[position] > 32) && !is_structural(input[position]) && (input[position] != '\"'))
+                {
+                    position++;
+                }
+                if (!index_push(index, start, position))
+                {
+                    goto fail;
+                }
+                break;
+        }
+    }
+
+    if ((depth == 0) && (index->count > 0))
+    {
+        return true;
+    }
+
+fail:
+    index->count = 0;
+
+    return false;
+}
+
+CJSON_PUBLIC(int) cJSON_CursorType(const cJSON_Cursor * const cursor)
+{
+    if (!cursor_is_valid(cursor))
+    {
+        return cJSON_Invalid;
+    }
+
+    switch (cursor->index->json[cursor->index->tokens[cursor->token].position])
+    {
+        case '{':
+            return cJSON_Object;
+        case '[':
+            return cJSON_Array;
+        case '\"':
+            return cJSON_String;
+        case 't':
+            return cJSON_True;
+        case 'f':
+            return cJSON_False;
+        case 'n':
+            return cJSON_NULL;
+        case '-':
+        case '0':
+        case '1':
+        case '2':
+        case '3':
+        case '4':
+        case '5':
+        case '6':
+        case '7':
+        case '8':
+        case '9':
+            return cJSON_Number;
+        default:
+            return cJSON_Invalid;
+    }
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_CursorGetField(const cJSON_Cursor * const object, const char * const name, cJSON_Cursor * const value)
+{
+    const cJSON_Index *index = NULL;
+    size_t token = 0;
+    size_t close = 0;
+    unsigned char first = '\0';
+
+    if (!cursor_is_valid(object) || (name == NULL) || (value == NULL))
+    {
+        return false;
+    }
+    index = object->index;
+    if (index->json[index->tokens[object->token].position] != '{')
+    {
+        return false;
+    }
+
+    close = index->tokens[object->token].end;
+    token = object->token + 1;
+    while (token < close)
+    {
+        /* "key" : value */
+        if ((index->json[index->tokens[token].position] != '\"') || ((token + 2) >= close) || (index->json[index->tokens[token + 1].position] != ':'))
+        {
+            return false;
+        }
+        first = index->json[index->tokens[token + 2].position];
+        if (is_structural(first) && (first != '{') && (first != '['))
+        {
+            return false;
+        }
+
+        if (index_string_equals(index, token, name, false))
+        {
+            value->index = index;
+            value->token = token + 2;
+            return true;
+        }
+
+        token = index_skip_value(index, token + 2);
+        if (token < close)
+        {
+            if (index->json[index->tokens[token].position] != ',')
+            {
+                return false;
+            }
+            token++;
+        }
+    }
+
+    return false;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_CursorStringEquals(const cJSON_Cursor * const string, const char * const value)
+{
+    if ((cJSON_CursorType(string) != cJSON_String) || (value == NULL))
+    {
+        return false;
+    }
+
+    return index_string_equals(string->index, string->token, value, true);
+}
+
+CJSON_PUBLIC(const char *) cJSON_CursorGetRaw(const cJSON_Cursor * const cursor, size_t * const length)
+{
+    size_t start = 0;
+
+    if (!cursor_is_valid(cursor))
+    {
+        return NULL;
+    }
+
+    start = cursor->index->tokens[cursor->token].position;
+    if (length != NULL)
+    {
+        *length = index_value_end(cursor->index, cursor->token) - start;
+    }
+
+    return (const char*)(cursor->index->json + start);
+}
+
+CJSON_PUBLIC(char *) cJSON_CursorGetStringInSitu(const cJSON_Cursor * const string, size_t * const length)
+{
+    const unsigned char *input = NULL;
+    const unsigned char *input_end = NULL;
+    unsigned char *start = NULL;
+    unsigned char *output = NULL;
+
+    if (cJSON_CursorType(string) != cJSON_String)
+    {
+        return NULL;
+    }
+
+    input = string->index->json + string->index->tokens[string->token].position + 1;
+    input_end = string->index->json + string->index->tokens[string->token].end - 1;
+    start = (unsigned char*)cast_away_const(input);
+    output = start;
+    if (!unescape_string(&input, input_end, &output))
+    {
+        return NULL;
+    }
+    if (length != NULL)
+    {
+        *length = (size_t)(output - start);
+    }
+
+    return (char*)start;
+}
+
+/* a member starts at token: "key" : value */
+static cJSON_bool index_is_member(const cJSON_Index * const index, const size_t token)
+{
+    unsigned char first = '\0';
+
+    if (((token + 2) >= index->count) || (index->json[index->tokens[token].position] != '\"') || (index->json[index->tokens[token + 1].position] != ':'))
+    {
+        return false;
+    }
+    first = index->json[index->tokens[token + 2].position];
+
+    return !is_structural(first) || (first == '{') || (first == '[');
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_CursorGetFirstMember(const cJSON_Cursor * const object, cJSON_Cursor * const name, cJSON_Cursor * const value)
+{
+    if ((cJSON_CursorType(object) != cJSON_Object) || (name == NULL) || (value == NULL) || !index_is_member(object->index, object->token + 1))
+    {
+        return false;
+    }
+
+    name->index = object->index;
+    name->token = object->token + 1;
+    value->index = object->index;
+    value->token = object->token + 3;
+
+    return true;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_CursorGetNextMember(cJSON_Cursor * const name, cJSON_Cursor * const value)
+{
+    size_t token = 0;
+
+    if (!cursor_is_valid(value) || (name == NULL))
+    {
+        return false;
+    }
+
+    token = index_skip_value(value->index, value->token);
+    if ((token >= value->index->count) || (value->index->json[value->index->tokens[token].position] != ',') || !index_is_member(value->index, token + 1))
+    {
+        return false;
+    }
+    name->index = value->index;
+    name->token = token + 1;
+    value->token = token + 3;
+
+    return true;
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_CursorParse(const cJSON_Cursor * const cursor, const cJSON_bool in_situ)
+{
+    size_t start = 0;
+
+    if (!cursor_is_valid(cursor))
+    {
+        return NULL;
+    }
+
+    start = cursor->index->tokens[cursor->token].position;
+    return parse_with_length((const char*)(cursor->index->json + start), index_value_end(cursor->index, cursor->token) - start, NULL, false, in_situ);
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_CursorGetNumber(const cJSON_Cursor * const number, double * const value)
+{
+    cJSON item;
+    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 }, 0 };
+
+    if ((cJSON_CursorType(number) != cJSON_Number) || (value == NULL))
+    {
+        return false;
+    }
+
+    memset(&item, 0, sizeof(item));
+    buffer.content = number->index->json + number->index->tokens[number->token].position;
+    buffer.length = number->index->tokens[number->token].end - number->index->tokens[number->token].position;
+    buffer.hooks = number->index->hooks;
+    if (!parse_number(&item, &buffer))
+    {
+        return false;
+    }
+    *value = item.valuedouble;
+
+    return true;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_CursorGetFirstItem(const cJSON_Cursor * const array, cJSON_Cursor * const item)
+{
+    if ((cJSON_CursorType(array) != cJSON_Array) || (item == NULL) || (array->index->tokens[array->token].end == array->token + 1))
+    {
+        return false;
+    }
+
+    item->index = array->index;
+    item->token = array->token + 1;
+
+    return true;
+}
+
+CJSON_PUBLIC(cJSON_bool) cJSON_CursorGetNextItem(cJSON_Cursor * const item)
+{
+    size_t token = 0;
+
+    if (!cursor_is_valid(item))
+    {
+        return false;
+    }
+
+    token = index_skip_value(item->index, item->token);
+    if ((token >= item->index->count) || (item->index->json[item->index->tokens[token].position] != ','))
+    {
+        return false;
+    }
+    item->token = token + 1;
+
+    return true;
+}
+
 /* Get Array size/item / object item. */
 CJSON_PUBLIC(int) cJSON_GetArraySize(const cJSON *array)
 {
@@ -153,20 +153,112 @@ CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks);
 /* Supply a block of JSON, and this returns a cJSON object you can interrogate. */
 CJSON_PUBLIC(cJSON *) cJSON_Parse(const char *value);
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_length);
+/* Check that json (length bytes) is exactly one well formed JSON value in valid UTF-8, without building anything.
+ * Stricter than cJSON_Parse: RFC 8259 numbers and whitespace, no raw control characters in strings. */
+CJSON_PUBLIC(cJSON_bool) cJSON_Validate(const char *json, size_t length);
+/* Check that text (length bytes, not a JSON document) is valid UTF-8: no overlong forms, surrogates or code points above U+10FFFF. */
+CJSON_PUBLIC(cJSON_bool) cJSON_ValidateUTF8(const char *text, size_t length);
 /* ParseWithOpts allows you to require (and check) that the JSON is null terminated, and to retrieve the pointer to the final byte parsed. */
 /* If you supply a ptr in return_parse_end and parsing fails, then return_parse_end will contain a pointer to the error so will match cJSON_GetErrorPtr(). */
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated);
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated);
 
+/* Framing of a byte stream (e.g. a TCP connection) that carries one JSON document after another. Feed the bytes in
+ * whatever chunks they arrive, the scanner keeps its state between calls and looks at every byte only once. Only
+ * strings and brackets are followed, so the caller keeps the bytes and still has to parse the document. Documents are
+ * objects or arrays, separated only by whitespace. complete is set when a document ended within the first consumed
+ * bytes of the chunk, so the rest can be scanned again. Returns 0 on a syntax error, after which the stream rejects
+ * everything until cJSON_StreamReset. */
+typedef struct cJSON_Stream cJSON_Stream;
+CJSON_PUBLIC(cJSON_Stream *) cJSON_CreateStream(void);
+CJSON_PUBLIC(void) cJSON_DeleteStream(cJSON_Stream *stream);
+CJSON_PUBLIC(cJSON_bool) cJSON_StreamScan(cJSON_Stream * const stream, const char *chunk, size_t length, size_t *consumed, cJSON_bool *complete);
+/* Drop any partial document and clear an error. */
+CJSON_PUBLIC(void) cJSON_StreamReset(cJSON_Stream * const stream);
+/* True between documents, i.e. when no partial document is pending. */
+CJSON_PUBLIC(cJSON_bool) cJSON_StreamIsIdle(const cJSON_Stream * const stream);
+
+/* In situ parsing: the strings and keys are unescaped inside value itself and the tree points into it instead of
+ * holding copies. value has to be writable and must outlive the returned tree, cJSON_Delete leaves it alone.
+ * Those items are flagged cJSON_IsReference (string values) and cJSON_StringIsConst (keys). */
+CJSON_PUBLIC(cJSON *) cJSON_ParseInSitu(char *value, size_t buffer_length);
+CJSON_PUBLIC(cJSON *) cJSON_ParseInSituWithOpts(char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated);
+
+/* On demand access: cJSON_IndexBuild makes one pass over json to record where every value starts and ends (only
+ * strings and brackets are checked) and sets root to the top level value. Cursors then walk that index, and nothing is
+ * parsed until cJSON_CursorParse is called on the value that is actually needed. json must stay unchanged while the
+ * index is used, and an index can be rebuilt for the next document to reuse its memory. */
+typedef struct cJSON_Index cJSON_Index;
+typedef struct cJSON_Cursor
+{
+    const cJSON_Index *index;
+    size_t token;
+} cJSON_Cursor;
+CJSON_PUBLIC(cJSON_Index *) cJSON_CreateIndex(void);
+CJSON_PUBLIC(void) cJSON_DeleteIndex(cJSON_Index *index);
+CJSON_PUBLIC(cJSON_bool) cJSON_IndexBuild(cJSON_Index * const index, const char *json, size_t length, cJSON_Cursor * const root);
+/* Type of the value under the cursor, judged by its first character (cJSON_Invalid if there is none). */
+CJSON_PUBLIC(int) cJSON_CursorType(const cJSON_Cursor * const cursor);
+/* Finds a member of an object, case insensitive like cJSON_GetObjectItem. Returns 0 if it's missing. */
+CJSON_PUBLIC(cJSON_bool) cJSON_CursorGetField(const cJSON_Cursor * const object, const char * const name, cJSON_Cursor * const value);
+/* Compares a string value with a C string, without unescaping it unless it has escapes. */
+CJSON_PUBLIC(cJSON_bool) cJSON_CursorStringEquals(const cJSON_Cursor * const string, const char * const value);
+/* Parses just the value under the cursor. With in_situ the json given to cJSON_IndexBuild must be writable and is
+ * used like in cJSON_ParseInSitu, after that the value must not be read through cursors again. */
+CJSON_PUBLIC(cJSON *) cJSON_CursorParse(const cJSON_Cursor * const cursor, const cJSON_bool in_situ);
+/* The value's bytes as they are in the json given to cJSON_IndexBuild (not zero terminated). NULL if invalid. */
+CJSON_PUBLIC(const char *) cJSON_CursorGetRaw(const cJSON_Cursor * const cursor, size_t * const length);
+/* Unescapes a string value in place (the json given to cJSON_IndexBuild must be writable) and returns a pointer to it
+ * inside that json, with its length if requested. Nothing is allocated. NULL if it's not a valid string. Same rule as
+ * above: do it once per value and don't read that value through cursors afterwards. */
+CJSON_PUBLIC(char *) cJSON_CursorGetStringInSitu(const cJSON_Cursor * const string, size_t * const length);
+/* Reads a number value like cJSON_Parse does, without allocating. Returns 0 if it's not a number. */
+CJSON_PUBLIC(cJSON_bool) cJSON_CursorGetNumber(const cJSON_Cursor * const number, double * const value);
+/* Walk the items of an array: the first one (0 if the array is empty), then each next one until it returns 0. */
+CJSON_PUBLIC(cJSON_bool) cJSON_CursorGetFirstItem(const cJSON_Cursor * const array, cJSON_Cursor * const item);
+CJSON_PUBLIC(cJSON_bool) cJSON_CursorGetNextItem(cJSON_Cursor * const item);
+/* Walk the members of an object: name is the member's key (a string value) and value its value; then each next one until it returns 0. */
+CJSON_PUBLIC(cJSON_bool) cJSON_CursorGetFirstMember(const cJSON_Cursor * const object, cJSON_Cursor * const name, cJSON_Cursor * const value);
+CJSON_PUBLIC(cJSON_bool) cJSON_CursorGetNextMember(cJSON_Cursor * const name, cJSON_Cursor * const value);
+
 /* Render a cJSON entity to text for transfer/storage. */
 CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item);
 /* Render a cJSON entity to text for transfer/storage without any formatting. */
 CJSON_PUBLIC(char *) cJSON_PrintUnformatted(const cJSON *item);
 /* Render a cJSON entity to text using a buffered strategy. prebuffer is a guess at the final size. guessing well reduces reallocation. fmt=0 gives unformatted, =1 gives formatted */
 CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON_bool fmt);
+/* Render a cJSON entity to text in chunks of chunk_size bytes, handing each full chunk (and the rest at the end) to flush
+ * instead of building the whole text, so e.g. a socket can be written as the text is produced. Memory stays at one
+ * chunk, only a single string or number longer than that gets a bigger one. flush returns 0 to abort the print.
+ * Returns 1 on success and 0 on failure. */
+typedef cJSON_bool (*cJSON_FlushCallback)(void *context, const char *data, size_t length);
+CJSON_PUBLIC(cJSON_bool) cJSON_PrintStreamed(const cJSON *item, cJSON_bool format, size_t chunk_size, cJSON_FlushCallback flush, void *context);
 /* Render a cJSON entity to text using a buffer already allocated in memory with given length. Returns 1 on success and 0 on failure. */
 /* NOTE: cJSON is not always 100% accurate in estimating how much memory it will use, so to be safe allocate 5 bytes more than you actually need */
 CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format);
+/* Exact buffer size (terminator and the slack mentioned above included) that cJSON_PrintPreallocated needs for item,
+ * found by printing it into a small scratch chunk without keeping the text. Returns 0 on failure. */
+CJSON_PUBLIC(size_t) cJSON_PrintMeasure(const cJSON *item, cJSON_bool format);
+/* Print into a buffer that is kept between calls, e.g. one per thread: once it is big enough there are no allocations
+ * at all. When the text doesn't fit, it is measured first so the buffer grows once to the exact size and the text is
+ * still written once. Returns reuse->buffer (zero terminated, length bytes long) or NULL on failure. Start with a zeroed
+ * cJSON_PrintBuffer and release it with cJSON_FreePrintBuffer. */
+typedef struct cJSON_PrintBuffer
+{
+    char *buffer;
+    size_t size;
+} cJSON_PrintBuffer;
+CJSON_PUBLIC(char *) cJSON_PrintReusable(const cJSON *item, cJSON_bool format, cJSON_PrintBuffer * const reuse, size_t * const length);
+CJSON_PUBLIC(void) cJSON_FreePrintBuffer(cJSON_PrintBuffer * const reuse);
+/* Precompiled output: the skeleton is JSON text where every '$' outside a string literal is a string slot, e.g.
+ * {"accion":"DM","mensaje":$}. Its constant bytes are stored once; a fill copies them around the escaped values
+ * (a NULL value prints null) into reuse, which works as in cJSON_PrintReusable. Returns reuse->buffer or NULL.
+ * An '@' slot takes a value that is already JSON text and copies it verbatim. */
+typedef struct cJSON_Template cJSON_Template;
+CJSON_PUBLIC(cJSON_Template *) cJSON_CreateTemplate(const char *skeleton);
+CJSON_PUBLIC(void) cJSON_DeleteTemplate(cJSON_Template *tmpl);
+CJSON_PUBLIC(size_t) cJSON_TemplateSlotCount(const cJSON_Template *tmpl);
+CJSON_PUBLIC(char *) cJSON_TemplateFill(const cJSON_Template *tmpl, const char * const *values, cJSON_PrintBuffer * const reuse, size_t * const length);
 /* Delete a cJSON entity and all subentities. */
 CJSON_PUBLIC(void) cJSON_Delete(cJSON *item);
 
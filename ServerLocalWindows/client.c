@@ -18,99 +18,228 @@
 #include <arpa/inet.h>
 #include <cjson/cJSON.h>
 #include <pthread.h>
+#include <time.h>
+#include <errno.h>
 
 #define BUFSIZE 1024
+#define MAX_RECEPCION 65536   // Mensaje más largo que puede mandar el servidor
+#define ESPERA_RESPUESTA 2    // Segundos que se espera la respuesta a una solicitud
+
+/********************************************************
+ * Cada solicitud lleva un "id" y el servidor lo devuelve
+ * en su respuesta: el menú espera esa respuesta en vez
+ * de dormir un tiempo fijo.
+ ********************************************************/
+static pthread_mutex_t respuestaMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t respuestaCond = PTHREAD_COND_INITIALIZER;
+static long ultimoId = 0;       // Último "id" enviado
+static long idRespondido = 0;   // Último "id" que ya tuvo respuesta
+
+/********************************************************
+ * mostrarMensaje()
+ * Imprime un mensaje del servidor ya parseado; buffer es
+ * el JSON tal como llegó.
+ ********************************************************/
+void mostrarMensaje(cJSON *root, const char *buffer) {
+    // El servidor puede usar "accion" o "tipo"
+    cJSON *accion = cJSON_GetObjectItem(root, "accion");
+    cJSON *tipo   = cJSON_GetObjectItem(root, "tipo");
+
+    // 1) Revisar "accion"
+    if (accion && cJSON_IsString(accion)) {
+        // Ej. "LISTA"
+        if (strcmp(accion->valuestring, "LISTA") == 0) {
+            cJSON *users = cJSON_GetObjectItem(root, "usuarios");
+            if (users && cJSON_IsArray(users)) {
+                printf("\n=== CONNECTED USERS ===\n");
+                int userCount = cJSON_GetArraySize(users);
+                for (int i = 0; i < userCount; i++) {
+                    cJSON *user = cJSON_GetArrayItem(users, i);
+                    printf("- %s\n", user->valuestring);
+                }
+                printf("========================\n");
+            } else {
+                printf("[Server] Error al recibir lista de usuarios.\n");
+            }
+        } else {
+            // Si el servidor manda algo con "accion" distinto de LISTA
+            printf("[Server]: %s\n", buffer);
+        }
+    }
+    // 2) Revisar "tipo"
+    else if (tipo && cJSON_IsString(tipo)) {
+        if (strcmp(tipo->valuestring, "MOSTRAR") == 0) {
+            // Ej. { "tipo":"MOSTRAR","usuario":"Cindy","estado":"ACTIVO" }
+            cJSON *usuario = cJSON_GetObjectItem(root, "usuario");
+            cJSON *estado  = cJSON_GetObjectItem(root, "estado");
+
+            if (usuario && cJSON_IsString(usuario) &&
+                estado && cJSON_IsString(estado)) {
+                printf("\n=== INFO USUARIO ===\n");
+                printf("Usuario: %s\n", usuario->valuestring);
+                printf("Estado : %s\n", estado->valuestring);
+                printf("====================\n");
+            } else {
+                // Puede ser un error como:
+                // {"respuesta":"ERROR","razon":"USUARIO_NO_ENCONTRADO"}
+                cJSON *respuesta = cJSON_GetObjectItem(root, "respuesta");
+                cJSON *razon     = cJSON_GetObjectItem(root, "razon");
+                if (respuesta && cJSON_IsString(respuesta) &&
+                    strcmp(respuesta->valuestring, "ERROR") == 0 &&
+                    razon && cJSON_IsString(razon)) {
+                    printf("[Server] MOSTRAR Error: %s\n", razon->valuestring);
+                } else {
+                    printf("[Server] Mensaje MOSTRAR desconocido: %s\n", buffer);
+                }
+            }
+        } else {
+            // Otros "tipo": REGISTRO, ESTADO, etc.
+            // El servidor podría mandar algo con "tipo":"REGISTRO" (aunque normalmente no).
+            printf("[Server] Mensaje tipo desconocido: %s\n", buffer);
+        }
+    }
+    else {
+        // Mensaje genérico
+        printf("[Server]: %s\n", buffer);
+    }
+}
+
+/********************************************************
+ * atenderDocumento()
+ * Parsea y muestra un JSON completo del servidor; si es
+ * la respuesta a una solicitud nuestra, la anota.
+ ********************************************************/
+void atenderDocumento(const char *json) {
+    cJSON *root = cJSON_Parse(json);
+    if (!root) {
+        printf("[Error] JSON inválido del servidor.\n");
+        return;
+    }
+    mostrarMensaje(root, json);
+
+    // Una respuesta (no un DM o BROADCAST reenviado) a una solicitud nuestra
+    cJSON *id = cJSON_GetObjectItem(root, "id");
+    if (cJSON_IsNumber(id) && !cJSON_IsTrue(cJSON_GetObjectItem(root, "verificado"))) {
+        pthread_mutex_lock(&respuestaMutex);
+        if ((long)id->valuedouble > idRespondido) {
+            idRespondido = (long)id->valuedouble;
+        }
+        pthread_cond_broadcast(&respuestaCond);
+        pthread_mutex_unlock(&respuestaMutex);
+    }
+    cJSON_Delete(root);
+}
 
 /********************************************************
  * receiveMessages()
  * Hilo que escucha constantemente los mensajes del servidor.
+ * Un recv puede traer varios JSON seguidos, o parte de uno:
+ * cada JSON termina donde se cierra su primer '{' o '['
+ * (contando solo fuera de los strings), y el estado del
+ * recorrido se guarda entre un recv y el siguiente.
  ********************************************************/
 void *receiveMessages(void *sock_desc) {
     int sock = *((int *)sock_desc);
-    char buffer[BUFSIZE];
+    static char buffer[MAX_RECEPCION + 1];
+    size_t usado = 0;
+    size_t escaneado = 0;   // Bytes ya recorridos
+    int profundidad = 0;
+    int enString = 0;
+    int escape = 0;
+    int descartando = 0;    // El JSON en curso no cupo: se tira hasta que termine
 
     while (1) {
-        memset(buffer, 0, BUFSIZE);
-        int bytes = recv(sock, buffer, BUFSIZE, 0);
+        if (usado == MAX_RECEPCION) {
+            printf("[Error] Mensaje demasiado largo del servidor.\n");
+            descartando = 1;
+            usado = 0;
+            escaneado = 0;
+        }
+        int bytes = recv(sock, buffer + usado, MAX_RECEPCION - usado, 0);
         if (bytes <= 0) {
             // Conexión cerrada o error
             break;
         }
-
-        // Parsear el JSON
-        cJSON *root = cJSON_Parse(buffer);
-        if (!root) {
-            printf("[Error] JSON inválido del servidor.\n");
-            continue;
-        }
-
-        // El servidor puede usar "accion" o "tipo"
-        cJSON *accion = cJSON_GetObjectItem(root, "accion");
-        cJSON *tipo   = cJSON_GetObjectItem(root, "tipo");
-
-        // 1) Revisar "accion"
-        if (accion && cJSON_IsString(accion)) {
-            // Ej. "LISTA"
-            if (strcmp(accion->valuestring, "LISTA") == 0) {
-                cJSON *users = cJSON_GetObjectItem(root, "usuarios");
-                if (users && cJSON_IsArray(users)) {
-                    printf("\n=== CONNECTED USERS ===\n");
-                    int userCount = cJSON_GetArraySize(users);
-                    for (int i = 0; i < userCount; i++) {
-                        cJSON *user = cJSON_GetArrayItem(users, i);
-                        printf("- %s\n", user->valuestring);
-                    }
-                    printf("========================\n");
-                } else {
-                    printf("[Server] Error al recibir lista de usuarios.\n");
+        usado += bytes;
+
+        size_t inicio = 0;   // Donde empieza el JSON en curso
+        for (; escaneado < usado; escaneado++) {
+            char c = buffer[escaneado];
+            if (profundidad == 0) {
+                // Entre un JSON y otro solo puede haber espacios
+                if (c == '{' || c == '[') {
+                    profundidad = 1;
+                    inicio = escaneado;
+                } else if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+                    printf("[Error] JSON inválido del servidor.\n");
+                    escaneado = usado;
+                    break;
                 }
-            } else {
-                // Si el servidor manda algo con "accion" distinto de LISTA
-                printf("[Server]: %s\n", buffer);
-            }
-        }
-        // 2) Revisar "tipo"
-        else if (tipo && cJSON_IsString(tipo)) {
-            if (strcmp(tipo->valuestring, "MOSTRAR") == 0) {
-                // Ej. { "tipo":"MOSTRAR","usuario":"Cindy","estado":"ACTIVO" }
-                cJSON *usuario = cJSON_GetObjectItem(root, "usuario");
-                cJSON *estado  = cJSON_GetObjectItem(root, "estado");
-
-                if (usuario && cJSON_IsString(usuario) &&
-                    estado && cJSON_IsString(estado)) {
-                    printf("\n=== INFO USUARIO ===\n");
-                    printf("Usuario: %s\n", usuario->valuestring);
-                    printf("Estado : %s\n", estado->valuestring);
-                    printf("====================\n");
-                } else {
-                    // Puede ser un error como:
-                    // {"respuesta":"ERROR","razon":"USUARIO_NO_ENCONTRADO"}
-                    cJSON *respuesta = cJSON_GetObjectItem(root, "respuesta");
-                    cJSON *razon     = cJSON_GetObjectItem(root, "razon");
-                    if (respuesta && cJSON_IsString(respuesta) &&
-                        strcmp(respuesta->valuestring, "ERROR") == 0 &&
-                        razon && cJSON_IsString(razon)) {
-                        printf("[Server] MOSTRAR Error: %s\n", razon->valuestring);
-                    } else {
-                        printf("[Server] Mensaje MOSTRAR desconocido: %s\n", buffer);
-                    }
+            } else if (enString) {
+                if (escape) {
+                    escape = 0;
+                } else if (c == '\\') {
+                    escape = 1;
+                } else if (c == '"') {
+                    enString = 0;
                 }
-            } else {
-                // Otros "tipo": REGISTRO, ESTADO, etc.
-                // El servidor podría mandar algo con "tipo":"REGISTRO" (aunque normalmente no).
-                printf("[Server] Mensaje tipo desconocido: %s\n", buffer);
+            } else if (c == '"') {
+                enString = 1;
+            } else if (c == '{' || c == '[') {
+                profundidad++;
+            } else if ((c == '}' || c == ']') && --profundidad == 0) {
+                char siguiente = buffer[escaneado + 1];
+                buffer[escaneado + 1] = '\0';
+                if (!descartando) {
+                    atenderDocumento(buffer + inicio);
+                }
+                buffer[escaneado + 1] = siguiente;
+                descartando = 0;
             }
         }
-        else {
-            // Mensaje genérico
-            printf("[Server]: %s\n", buffer);
+        if (profundidad == 0 || descartando) {
+            inicio = escaneado;
         }
 
-        cJSON_Delete(root);
+        usado -= inicio;
+        escaneado -= inicio;
+        memmove(buffer, buffer + inicio, usado);
     }
     return NULL;
 }
 
+/********************************************************
+ * enviarSolicitud()
+ * Agrega un "id" a la solicitud, la envía y, si esperar,
+ * aguarda su respuesta para no reimprimir el menú antes.
+ ********************************************************/
+void enviarSolicitud(int sock, cJSON *solicitud, int esperar) {
+    pthread_mutex_lock(&respuestaMutex);
+    long id = ++ultimoId;
+    pthread_mutex_unlock(&respuestaMutex);
+    cJSON_AddNumberToObject(solicitud, "id", id);
+
+    char *strJson = cJSON_PrintUnformatted(solicitud);
+    send(sock, strJson, strlen(strJson), 0);
+    free(strJson);
+    if (!esperar) {
+        return;
+    }
+
+    struct timespec limite;
+    clock_gettime(CLOCK_REALTIME, &limite);
+    limite.tv_sec += ESPERA_RESPUESTA;
+
+    pthread_mutex_lock(&respuestaMutex);
+    while (idRespondido < id) {
+        if (pthread_cond_timedwait(&respuestaCond, &respuestaMutex, &limite) == ETIMEDOUT) {
+            printf("[Aviso] Sin respuesta del servidor.\n");
+            break;
+        }
+    }
+    pthread_mutex_unlock(&respuestaMutex);
+}
+
 int main(int argc, char *argv[]) {
     if (argc < 4) {
         printf("Uso: %s <nombreUsuario> <IPdelservidor> <puertodelservidor>\n", argv[0]);
@@ -150,27 +279,26 @@ int main(int argc, char *argv[]) {
     pthread_create(&hiloRecepcion, NULL, receiveMessages, &client_fd);
     pthread_detach(hiloRecepcion);
 
-    // Enviar REGISTRO (sin bloquear la ejecución principal)
+    // Enviar REGISTRO; el hilo de recepción muestra la respuesta
     {
         cJSON *regJson = cJSON_CreateObject();
         cJSON_AddStringToObject(regJson, "tipo", "REGISTRO");
         cJSON_AddStringToObject(regJson, "usuario", nombreUsuario);
-       // cJSON_AddStringToObject(regJson, "direccionIP", ipServidor);
+        // Pedir respuestas sin espacios ni saltos de línea
+        cJSON_AddStringToObject(regJson, "formato", "COMPACTO");
+        // La IP local con la que salió la conexión
+        struct sockaddr_in local;
+        socklen_t largoLocal = sizeof(local);
+        char ipLocal[INET_ADDRSTRLEN] = "0.0.0.0";
+        if (getsockname(client_fd, (struct sockaddr*)&local, &largoLocal) == 0) {
+            inet_ntop(AF_INET, &local.sin_addr, ipLocal, sizeof(ipLocal));
+        }
+        cJSON_AddStringToObject(regJson, "direccionIP", ipLocal);
 
-        char *strReg = cJSON_Print(regJson);
-        send(client_fd, strReg, strlen(strReg), 0);
-        free(strReg);
+        enviarSolicitud(client_fd, regJson, 1);
         cJSON_Delete(regJson);
-
-        char buffer[BUFSIZE];
-        int bytes = recv(client_fd, buffer, BUFSIZE - 1, MSG_DONTWAIT);  //  No bloquea
-        if (bytes > 0) {
-            buffer[bytes] = '\0';
-            printf("[Servidor]: %s\n", buffer); 
-        }
     }
 
-    usleep(200000);
     // Bucle principal (menú)
     while (1) {
         // Mostramos el menú
@@ -201,14 +329,9 @@ int main(int argc, char *argv[]) {
             cJSON_AddStringToObject(bcast, "nombre_emisor", nombreUsuario);
             cJSON_AddStringToObject(bcast, "mensaje", msg);
 
-            char *strJson = cJSON_Print(bcast);
-            send(client_fd, strJson, strlen(strJson), 0);
-
-            // Espera breve para que el hilo de recepción
-            // muestre antes de reimprimir menú.
-            usleep(300000);
-
-            free(strJson);
+            // Espera la respuesta para que el hilo de recepción
+            // la muestre antes de reimprimir menú.
+            enviarSolicitud(client_fd, bcast, 1);
             cJSON_Delete(bcast);
 
         } else if (strcmp(opcion, "2") == 0) {
@@ -228,12 +351,7 @@ int main(int argc, char *argv[]) {
             cJSON_AddStringToObject(dm, "nombre_destinatario", dest);
             cJSON_AddStringToObject(dm, "mensaje", msg);
 
-            char *strJson = cJSON_Print(dm);
-            send(client_fd, strJson, strlen(strJson), 0);
-
-            usleep(300000);
-
-            free(strJson);
+            enviarSolicitud(client_fd, dm, 1);
             cJSON_Delete(dm);
 
         } else if (strcmp(opcion, "3") == 0) {
@@ -242,14 +360,9 @@ int main(int argc, char *argv[]) {
             cJSON_AddStringToObject(lst, "accion", "LISTA");
             cJSON_AddStringToObject(lst, "nombre_usuario", nombreUsuario);
 
-            char *strJson = cJSON_Print(lst);
-            send(client_fd, strJson, strlen(strJson), 0);
-
-            // Pausa breve para que el mensaje se reciba 
+            // Espera a que el mensaje se reciba
             // y se muestre antes de reimprimir el menú.
-            usleep(300000);
-
-            free(strJson);
+            enviarSolicitud(client_fd, lst, 1);
             cJSON_Delete(lst);
 
         } else if (strcmp(opcion, "4") == 0) {
@@ -263,12 +376,7 @@ int main(int argc, char *argv[]) {
             cJSON_AddStringToObject(most, "tipo", "MOSTRAR");
             cJSON_AddStringToObject(most, "usuario", usuario);
 
-            char *strJson = cJSON_Print(most);
-            send(client_fd, strJson, strlen(strJson), 0);
-
-            usleep(300000);
-
-            free(strJson);
+            enviarSolicitud(client_fd, most, 1);
             cJSON_Delete(most);
 
         } else if (strcmp(opcion, "5") == 0) {
@@ -283,12 +391,7 @@ int main(int argc, char *argv[]) {
             cJSON_AddStringToObject(est, "usuario", nombreUsuario);
             cJSON_AddStringToObject(est, "estado", nuevoEstado);
 
-            char *estStr = cJSON_Print(est);
-            send(client_fd, estStr, strlen(estStr), 0);
-
-            usleep(300000);
-
-            free(estStr);
+            enviarSolicitud(client_fd, est, 1);
             cJSON_Delete(est);
 
         } else if (strcmp(opcion, "6") == 0) {
@@ -297,7 +400,7 @@ int main(int argc, char *argv[]) {
             cJSON_AddStringToObject(ex, "tipo", "EXIT");
             cJSON_AddStringToObject(ex, "usuario", nombreUsuario);
 
-            char *exStr = cJSON_Print(ex);
+            char *exStr = cJSON_PrintUnformatted(ex);
             send(client_fd, exStr, strlen(exStr), 0);
             free(exStr);
             cJSON_Delete(ex);
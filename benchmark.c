@@ -0,0 +1,254 @@
+/********************************************************
+ * benchmark.c
+ * Compara el formato con sangría (cJSON_Print) contra el
+ * compacto (cJSON_PrintUnformatted) en los mensajes que
+ * manda el servidor: bytes por mensaje y tiempo de impresión.
+ * Para DM y BROADCAST compara además armar el árbol e
+ * imprimirlo contra llenar la plantilla precompilada, y
+ * el trabajo del servidor por DM recibido en JSON contra
+ * el mismo DM en un marco binario (sin contar sockets).
+ *
+ * Compilación:
+ *   gcc -O2 benchmark.c ServerLocalWindows/cJSON.c -o benchmark -lm
+ ********************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ServerLocalWindows/cJSON.h"
+#include "protocolo.h"
+
+#define ITERACIONES 200000
+
+typedef struct {
+    const char *nombre;
+    cJSON *mensaje;
+} Caso;
+
+double segundos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Tiempo promedio en nanosegundos de imprimir el mensaje (reutilizando el buffer, como el servidor)
+double medir(cJSON *mensaje, int formato, size_t *bytes) {
+    cJSON_PrintBuffer buffer = { NULL, 0 };
+    size_t largo = 0;
+    cJSON_PrintReusable(mensaje, formato, &buffer, &largo);  // Calentar y dimensionar el buffer
+
+    double inicio = segundos();
+    for (int i = 0; i < ITERACIONES; i++) {
+        cJSON_PrintReusable(mensaje, formato, &buffer, &largo);
+    }
+    double total = segundos() - inicio;
+
+    cJSON_FreePrintBuffer(&buffer);
+    *bytes = largo;
+    return total * 1e9 / ITERACIONES;
+}
+
+// Como el servidor antes de las plantillas: árbol con referencias + impresión
+double medirArbol(const char *const valores[], int dm, int formato) {
+    cJSON_PrintBuffer buffer = { NULL, 0 };
+    size_t largo = 0;
+
+    double inicio = segundos();
+    for (int i = 0; i < ITERACIONES; i++) {
+        cJSON *obj = cJSON_CreateObject();
+        cJSON_AddStringToObject(obj, "accion", dm ? "DM" : "BROADCAST");
+        cJSON_AddItemToObjectCS(obj, "nombre_emisor", cJSON_CreateStringReference(valores[0]));
+        if (dm) {
+            cJSON_AddItemToObjectCS(obj, "nombre_destinatario", cJSON_CreateStringReference(valores[1]));
+        }
+        cJSON_AddItemToObjectCS(obj, "mensaje", cJSON_CreateStringReference(valores[dm ? 2 : 1]));
+        cJSON_PrintReusable(obj, formato, &buffer, &largo);
+        cJSON_Delete(obj);
+    }
+    double total = segundos() - inicio;
+
+    cJSON_FreePrintBuffer(&buffer);
+    return total * 1e9 / ITERACIONES;
+}
+
+double medirPlantilla(const char *esqueleto, const char *const valores[]) {
+    cJSON_Template *plantilla = cJSON_CreateTemplate(esqueleto);
+    cJSON_PrintBuffer buffer = { NULL, 0 };
+    size_t largo = 0;
+
+    double inicio = segundos();
+    for (int i = 0; i < ITERACIONES; i++) {
+        cJSON_TemplateFill(plantilla, valores, &buffer, &largo);
+    }
+    double total = segundos() - inicio;
+
+    cJSON_FreePrintBuffer(&buffer);
+    cJSON_DeleteTemplate(plantilla);
+    return total * 1e9 / ITERACIONES;
+}
+
+// Un DM recibido en JSON, como en manejarCliente y procesarSolicitud:
+// validar, indexar, buscar "accion", copiar el original y leer los campos
+double medirEntradaJSON(const char *texto) {
+    size_t largo = strlen(texto);
+    char *entrada = malloc(largo);
+    char *copia = malloc(largo);
+    cJSON_Index *indice = cJSON_CreateIndex();
+    cJSON_Cursor raiz, valor;
+    MensajeDM m;
+    int leidos = 0;
+
+    double inicio = segundos();
+    for (int i = 0; i < ITERACIONES; i++) {
+        memcpy(entrada, texto, largo);  // recv
+        if (cJSON_Validate(entrada, largo) && cJSON_IndexBuild(indice, entrada, largo, &raiz) &&
+            cJSON_CursorGetField(&raiz, "accion", &valor) && cJSON_CursorStringEquals(&valor, "DM")) {
+            memcpy(copia, entrada, largo);
+            leidos += leerDM(&raiz, &m);
+        }
+    }
+    double total = segundos() - inicio;
+
+    cJSON_DeleteIndex(indice);
+    free(entrada);
+    free(copia);
+    return leidos == ITERACIONES ? total * 1e9 / ITERACIONES : -1;
+}
+
+// El mismo DM en un marco binario, como en procesarMarco
+double medirEntradaBinaria(const unsigned char *marco, size_t largo) {
+    unsigned char *entrada = malloc(largo);
+    unsigned char *copia = malloc(largo);
+    const unsigned char *nombre;
+    size_t largoNombre;
+    MensajeDM m;
+    int leidos = 0;
+
+    double inicio = segundos();
+    for (int i = 0; i < ITERACIONES; i++) {
+        memcpy(entrada, marco, largo);  // recv
+        if (buscarClaveBinaria(entrada, largo, "accion", &nombre, &largoNombre) == 1 &&
+            largoNombre == 2 && memcmp(nombre, "DM", 2) == 0) {
+            memcpy(copia, entrada, largo);
+            leidos += decodificarDM(entrada, largo, &m);
+        }
+    }
+    double total = segundos() - inicio;
+
+    free(entrada);
+    free(copia);
+    return leidos == ITERACIONES ? total * 1e9 / ITERACIONES : -1;
+}
+
+// Armar el DM para un destinatario del otro formato
+double medirSalida(const MensajeDM *m, int binario) {
+    cJSON_PrintBuffer buffer = { NULL, 0 };
+    size_t largo = 0;
+
+    double inicio = segundos();
+    for (int i = 0; i < ITERACIONES; i++) {
+        if (binario) {
+            codificarDM(m, 1, &buffer, &largo);
+        } else {
+            serializarDM(m, 1, &buffer, &largo);
+        }
+    }
+    double total = segundos() - inicio;
+
+    cJSON_FreePrintBuffer(&buffer);
+    return total * 1e9 / ITERACIONES;
+}
+
+int main() {
+    Caso casos[5];
+
+    casos[0].nombre = "OK";
+    casos[0].mensaje = cJSON_CreateObject();
+    cJSON_AddStringToObject(casos[0].mensaje, "respuesta", "OK");
+
+    casos[1].nombre = "ERROR";
+    casos[1].mensaje = cJSON_CreateObject();
+    cJSON_AddStringToObject(casos[1].mensaje, "respuesta", "ERROR");
+    cJSON_AddStringToObject(casos[1].mensaje, "razon", "DESTINATARIO_NO_ENCONTRADO");
+
+    casos[2].nombre = "DM";
+    casos[2].mensaje = cJSON_CreateObject();
+    cJSON_AddStringToObject(casos[2].mensaje, "accion", "DM");
+    cJSON_AddStringToObject(casos[2].mensaje, "nombre_emisor", "Cindy");
+    cJSON_AddStringToObject(casos[2].mensaje, "nombre_destinatario", "Pablo");
+    cJSON_AddStringToObject(casos[2].mensaje, "mensaje", "hola, nos vemos a las 3 en el laboratorio?");
+
+    casos[3].nombre = "BROADCAST";
+    casos[3].mensaje = cJSON_CreateObject();
+    cJSON_AddStringToObject(casos[3].mensaje, "accion", "BROADCAST");
+    cJSON_AddStringToObject(casos[3].mensaje, "nombre_emisor", "Cindy");
+    cJSON_AddStringToObject(casos[3].mensaje, "mensaje", "buenas tardes a todos");
+
+    casos[4].nombre = "LISTA (10)";
+    casos[4].mensaje = cJSON_CreateObject();
+    cJSON_AddStringToObject(casos[4].mensaje, "accion", "LISTA");
+    cJSON *usuarios = cJSON_AddArrayToObject(casos[4].mensaje, "usuarios");
+    for (int i = 0; i < 10; i++) {
+        char nombre[20];
+        snprintf(nombre, sizeof(nombre), "usuario%d", i);
+        cJSON_AddItemToArray(usuarios, cJSON_CreateString(nombre));
+    }
+
+    printf("%-12s %10s %10s %8s %12s %12s %8s\n",
+           "mensaje", "bytes fmt", "bytes cmp", "ahorro", "ns fmt", "ns cmp", "ahorro");
+    for (int i = 0; i < 5; i++) {
+        size_t bytesFormato = 0, bytesCompacto = 0;
+        double nsFormato = medir(casos[i].mensaje, 1, &bytesFormato);
+        double nsCompacto = medir(casos[i].mensaje, 0, &bytesCompacto);
+        printf("%-12s %10zu %10zu %7.1f%% %12.1f %12.1f %7.1f%%\n",
+               casos[i].nombre, bytesFormato, bytesCompacto,
+               100.0 * (1.0 - (double)bytesCompacto / bytesFormato),
+               nsFormato, nsCompacto, 100.0 * (1.0 - nsCompacto / nsFormato));
+        cJSON_Delete(casos[i].mensaje);
+    }
+
+    static const char *const valoresDM[] = { "Cindy", "Pablo", "hola, nos vemos a las 3 en el laboratorio?" };
+    static const char *const valoresBroadcast[] = { "Cindy", "buenas tardes a todos" };
+    printf("\n%-14s %12s %12s %8s\n", "reenvío", "ns árbol", "ns plantilla", "ahorro");
+    for (int compacto = 0; compacto <= 1; compacto++) {
+        double arbol = medirArbol(valoresDM, 1, !compacto);
+        double plantilla = medirPlantilla(compacto
+            ? "{\"accion\":\"DM\",\"nombre_emisor\":$,\"nombre_destinatario\":$,\"mensaje\":$}"
+            : "{\n\t\"accion\":\t\"DM\",\n\t\"nombre_emisor\":\t$,\n\t\"nombre_destinatario\":\t$,\n\t\"mensaje\":\t$\n}",
+            valoresDM);
+        printf("%-14s %12.1f %12.1f %7.1f%%\n", compacto ? "DM cmp" : "DM fmt",
+               arbol, plantilla, 100.0 * (1.0 - plantilla / arbol));
+
+        arbol = medirArbol(valoresBroadcast, 0, !compacto);
+        plantilla = medirPlantilla(compacto
+            ? "{\"accion\":\"BROADCAST\",\"nombre_emisor\":$,\"mensaje\":$}"
+            : "{\n\t\"accion\":\t\"BROADCAST\",\n\t\"nombre_emisor\":\t$,\n\t\"mensaje\":\t$\n}",
+            valoresBroadcast);
+        printf("%-14s %12.1f %12.1f %7.1f%%\n", compacto ? "BROADCAST cmp" : "BROADCAST fmt",
+               arbol, plantilla, 100.0 * (1.0 - plantilla / arbol));
+    }
+
+    crearPlantillas();
+    static const char *const mensajes[] = { "hola, nos vemos a las 3 en el laboratorio?",
+        "Reporte diario: 1523 pedidos procesados, 12 pendientes de revisión, 3 con error de pago; "
+        "el detalle está en el tablero de operaciones y se actualiza cada cinco minutos. "
+        "Avisar a soporte si los pendientes pasan de 50 antes de las 18:00." };
+    printf("\n%-14s %10s %10s %10s %10s %8s\n", "DM recibido", "bytes JSON", "bytes bin", "ns JSON", "ns binario", "veces");
+    for (int i = 0; i < 2; i++) {
+        MensajeDM m = { MSJ_DM, "Cindy", { "Pablo" }, 1, 0, SIN_ENTERO, mensajes[i] };
+        cJSON_PrintBuffer json = { NULL, 0 }, binario = { NULL, 0 };
+        size_t largoJSON = 0, largoBinario = 0;
+        char *texto = serializarDM(&m, 1, &json, &largoJSON);
+        char *marco = codificarDM(&m, 0, &binario, &largoBinario);
+        texto[largoJSON] = '\0';
+
+        double nsJSON = medirEntradaJSON(texto);
+        double nsBinario = medirEntradaBinaria((unsigned char *)marco + LARGO_MARCO, largoBinario - LARGO_MARCO);
+        printf("%-14s %10zu %10zu %10.1f %10.1f %7.1fx\n", i == 0 ? "corto" : "largo",
+               largoJSON, largoBinario, nsJSON, nsBinario, nsJSON / nsBinario);
+        printf("%-14s %10s %10s %10.1f %10.1f\n", "  + armar", "", "", medirSalida(&m, 0), medirSalida(&m, 1));
+        cJSON_FreePrintBuffer(&json);
+        cJSON_FreePrintBuffer(&binario);
+    }
+    return 0;
+}
@@ -0,0 +1,488 @@
+/********************************************************
+ * binario.h
+ * Codificación binaria del protocolo, para los clientes
+ * que la piden en el REGISTRO ("formato":"BINARIO").
+ * Cada mensaje es un marco: 4 bytes con el largo (big
+ * endian) y un mapa MessagePack con las mismas claves
+ * y valores que el JSON. Se usa el subconjunto que el
+ * JSON puede representar: mapas, arreglos, strings,
+ * enteros, float64, true, false y nil.
+ *
+ * La lectura es en el mismo buffer del marco: un string
+ * se corre un byte sobre su encabezado para terminarlo
+ * en '\0', igual que la lectura in situ del JSON.
+ ********************************************************/
+#ifndef BINARIO_H
+#define BINARIO_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "ServerLocalWindows/cJSON.h"
+
+#define LARGO_MARCO 4                // Bytes del largo al inicio de cada marco
+#define PROFUNDIDAD_BINARIA CJSON_NESTING_LIMIT
+
+static inline size_t leerLargoMarco(const unsigned char *p) {
+    return ((size_t)p[0] << 24) | ((size_t)p[1] << 16) | ((size_t)p[2] << 8) | (size_t)p[3];
+}
+
+static inline void escribirLargoMarco(unsigned char *p, size_t largo) {
+    p[0] = (unsigned char)(largo >> 24);
+    p[1] = (unsigned char)(largo >> 16);
+    p[2] = (unsigned char)(largo >> 8);
+    p[3] = (unsigned char)largo;
+}
+
+/********************************************************
+* Escritura: sobre un cJSON_PrintBuffer que se reutiliza
+* entre mensajes y solo crece cuando no alcanza.
+********************************************************/
+typedef struct {
+    cJSON_PrintBuffer *buffer;
+    size_t largo;   // Bytes escritos
+    int fallo;      // Sin memoria o valor que no se puede codificar
+} Escritor;
+
+// Espacio para n bytes más; NULL (y fallo) si no hay memoria
+static inline unsigned char *reservar(Escritor *e, size_t n) {
+    if (e->fallo) {
+        return NULL;
+    }
+    if (e->buffer->buffer == NULL || e->largo + n > e->buffer->size) {
+        size_t nuevoLargo = (e->largo + n) * 2 + 64;
+        char *nuevo = (char *)cJSON_malloc(nuevoLargo);
+        if (nuevo == NULL) {
+            e->fallo = 1;
+            return NULL;
+        }
+        if (e->buffer->buffer != NULL) {
+            memcpy(nuevo, e->buffer->buffer, e->largo);
+            cJSON_free(e->buffer->buffer);
+        }
+        e->buffer->buffer = nuevo;
+        e->buffer->size = nuevoLargo;
+    }
+    unsigned char *p = (unsigned char *)e->buffer->buffer + e->largo;
+    e->largo += n;
+    return p;
+}
+
+static inline void escribirBytes(Escritor *e, const void *datos, size_t n) {
+    unsigned char *p = reservar(e, n);
+    if (p != NULL) {
+        memcpy(p, datos, n);
+    }
+}
+
+// Un byte de tipo y n en big endian con 'bytes' bytes
+static inline void escribirTipoLargo(Escritor *e, unsigned char tipo, uint64_t n, int bytes) {
+    unsigned char *p = reservar(e, (size_t)bytes + 1);
+    if (p == NULL) {
+        return;
+    }
+    p[0] = tipo;
+    for (int i = bytes; i > 0; i--) {
+        p[i] = (unsigned char)n;
+        n >>= 8;
+    }
+}
+
+static inline void escribirMapa(Escritor *e, size_t n) {
+    if (n < 16) {
+        escribirTipoLargo(e, (unsigned char)(0x80 | n), 0, 0);
+    } else if (n <= 0xffff) {
+        escribirTipoLargo(e, 0xde, n, 2);
+    } else {
+        escribirTipoLargo(e, 0xdf, n, 4);
+    }
+}
+
+static inline void escribirArreglo(Escritor *e, size_t n) {
+    if (n < 16) {
+        escribirTipoLargo(e, (unsigned char)(0x90 | n), 0, 0);
+    } else if (n <= 0xffff) {
+        escribirTipoLargo(e, 0xdc, n, 2);
+    } else {
+        escribirTipoLargo(e, 0xdd, n, 4);
+    }
+}
+
+static inline void escribirStr(Escritor *e, const char *s, size_t n) {
+    if (n < 32) {
+        escribirTipoLargo(e, (unsigned char)(0xa0 | n), 0, 0);
+    } else if (n <= 0xff) {
+        escribirTipoLargo(e, 0xd9, n, 1);
+    } else if (n <= 0xffff) {
+        escribirTipoLargo(e, 0xda, n, 2);
+    } else {
+        escribirTipoLargo(e, 0xdb, n, 4);
+    }
+    escribirBytes(e, s, n);
+}
+
+static inline void escribirCadena(Escritor *e, const char *s) {
+    escribirStr(e, s, strlen(s));
+}
+
+static inline void escribirBool(Escritor *e, int valor) {
+    escribirTipoLargo(e, valor ? 0xc3 : 0xc2, 0, 0);
+}
+
+static inline void escribirNulo(Escritor *e) {
+    escribirTipoLargo(e, 0xc0, 0, 0);
+}
+
+// Los números enteros van con el entero más corto; el resto como float64
+static inline void escribirNumero(Escritor *e, double x) {
+    if (x == floor(x) && x >= -9223372036854775808.0 && x < 9223372036854775808.0) {
+        int64_t n = (int64_t)x;
+        if (n >= 0) {
+            uint64_t u = (uint64_t)n;
+            if (u < 128) {
+                escribirTipoLargo(e, (unsigned char)u, 0, 0);
+            } else if (u <= 0xff) {
+                escribirTipoLargo(e, 0xcc, u, 1);
+            } else if (u <= 0xffff) {
+                escribirTipoLargo(e, 0xcd, u, 2);
+            } else if (u <= 0xffffffffu) {
+                escribirTipoLargo(e, 0xce, u, 4);
+            } else {
+                escribirTipoLargo(e, 0xcf, u, 8);
+            }
+        } else if (n >= -32) {
+            escribirTipoLargo(e, (unsigned char)(0xe0 | (n + 32)), 0, 0);
+        } else if (n >= INT8_MIN) {
+            escribirTipoLargo(e, 0xd0, (uint64_t)n, 1);
+        } else if (n >= INT16_MIN) {
+            escribirTipoLargo(e, 0xd1, (uint64_t)n, 2);
+        } else if (n >= INT32_MIN) {
+            escribirTipoLargo(e, 0xd2, (uint64_t)n, 4);
+        } else {
+            escribirTipoLargo(e, 0xd3, (uint64_t)n, 8);
+        }
+        return;
+    }
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    escribirTipoLargo(e, 0xcb, bits, 8);
+}
+
+// Un valor cJSON completo (respuestas que el servidor arma como árbol)
+static inline void escribirItem(Escritor *e, const cJSON *item, int profundidad) {
+    if (profundidad > PROFUNDIDAD_BINARIA) {
+        e->fallo = 1;
+        return;
+    }
+    switch (item->type & 0xff) {
+        case cJSON_NULL:
+            escribirNulo(e);
+            break;
+        case cJSON_False:
+            escribirBool(e, 0);
+            break;
+        case cJSON_True:
+            escribirBool(e, 1);
+            break;
+        case cJSON_Number:
+            escribirNumero(e, item->valuedouble);
+            break;
+        case cJSON_String:
+            escribirCadena(e, item->valuestring);
+            break;
+        case cJSON_Array:
+        case cJSON_Object: {
+            size_t n = 0;
+            for (const cJSON *hijo = item->child; hijo != NULL; hijo = hijo->next) {
+                n++;
+            }
+            if (cJSON_IsArray(item)) {
+                escribirArreglo(e, n);
+            } else {
+                escribirMapa(e, n);
+            }
+            for (const cJSON *hijo = item->child; hijo != NULL; hijo = hijo->next) {
+                if (cJSON_IsObject(item)) {
+                    escribirCadena(e, hijo->string);
+                }
+                escribirItem(e, hijo, profundidad + 1);
+            }
+            break;
+        }
+        default:  // cJSON_Raw y cJSON_Invalid no tienen equivalente
+            e->fallo = 1;
+            break;
+    }
+}
+
+// Marco completo (largo + valor) en buffer; NULL si falla
+static inline char *imprimirBinario(const cJSON *item, cJSON_PrintBuffer *buffer, size_t *largo) {
+    Escritor e = { buffer, 0, 0 };
+    reservar(&e, LARGO_MARCO);
+    escribirItem(&e, item, 0);
+    if (e.fallo) {
+        return NULL;
+    }
+    escribirLargoMarco((unsigned char *)buffer->buffer, e.largo - LARGO_MARCO);
+    *largo = e.largo;
+    return buffer->buffer;
+}
+
+/********************************************************
+* Lectura: un cursor sobre el marco (sin los 4 bytes del
+* largo). Cada función retorna 0 si el valor no es del
+* tipo pedido o se sale del marco.
+********************************************************/
+typedef struct {
+    unsigned char *p;
+    unsigned char *fin;
+} Lector;
+
+// Entero big endian de n bytes
+static inline int leerEntero(Lector *l, int n, uint64_t *valor) {
+    if (l->fin - l->p < n) {
+        return 0;
+    }
+    *valor = 0;
+    for (int i = 0; i < n; i++) {
+        *valor = (*valor << 8) | *l->p++;
+    }
+    return 1;
+}
+
+// Encabezado de mapa o arreglo: corto (base | n, n < 16) o con 2 o 4 bytes
+static inline int leerContenedor(Lector *l, unsigned char base, unsigned char tipo16, size_t *n) {
+    uint64_t valor;
+    if (l->p == l->fin) {
+        return 0;
+    }
+    unsigned char b = *l->p;
+    if ((b & 0xf0) == base) {
+        l->p++;
+        *n = b & 0x0f;
+        return 1;
+    }
+    if (b != tipo16 && b != tipo16 + 1) {
+        return 0;
+    }
+    l->p++;
+    if (!leerEntero(l, b == tipo16 ? 2 : 4, &valor)) {
+        return 0;
+    }
+    *n = (size_t)valor;
+    return 1;
+}
+
+static inline int leerMapa(Lector *l, size_t *n) {
+    return leerContenedor(l, 0x80, 0xde, n);
+}
+
+static inline int leerArreglo(Lector *l, size_t *n) {
+    return leerContenedor(l, 0x90, 0xdc, n);
+}
+
+// String: deja s apuntando a sus bytes (sin terminar en '\0')
+static inline int leerStr(Lector *l, unsigned char **s, size_t *n) {
+    uint64_t valor;
+    if (l->p == l->fin) {
+        return 0;
+    }
+    unsigned char b = *l->p++;
+    if ((b & 0xe0) == 0xa0) {
+        valor = b & 0x1f;
+    } else if (b < 0xd9 || b > 0xdb || !leerEntero(l, 1 << (b - 0xd9), &valor)) {
+        return 0;
+    }
+    if ((uint64_t)(l->fin - l->p) < valor) {
+        return 0;
+    }
+    *s = l->p;
+    *n = (size_t)valor;
+    l->p += valor;
+    return 1;
+}
+
+// String terminado en '\0' en el mismo marco: sus bytes se corren uno
+// hacia atrás, sobre el último byte del encabezado. NULL si no es un
+// string, trae un '\0' o no es UTF-8 válido (se reenvía a clientes JSON).
+static inline char *leerCadenaInSitu(Lector *l, size_t *largo) {
+    unsigned char *s;
+    if (!leerStr(l, &s, largo) || memchr(s, '\0', *largo) != NULL ||
+        !cJSON_ValidateUTF8((const char *)s, *largo)) {
+        return NULL;
+    }
+    memmove(s - 1, s, *largo);
+    (s - 1)[*largo] = '\0';
+    return (char *)(s - 1);
+}
+
+// Arreglo de hasta maximo strings, cada uno terminado en '\0' en el marco
+static inline int leerCadenas(Lector *l, int maximo, size_t largoMaximo, const char **destino, int *cantidad) {
+    size_t n, largo;
+    if (!leerArreglo(l, &n) || n > (size_t)maximo) {
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        destino[i] = leerCadenaInSitu(l, &largo);
+        if (destino[i] == NULL || (largoMaximo != 0 && largo > largoMaximo)) {
+            return 0;
+        }
+    }
+    *cantidad = (int)n;
+    return 1;
+}
+
+// Un string, o un arreglo de 1 a maximo strings (lista dice cuál vino)
+static inline int leerDestinos(Lector *l, int maximo, size_t largoMaximo, const char **destino,
+                               int *cantidad, int *lista) {
+    size_t largo;
+    if (l->p == l->fin) {
+        return 0;
+    }
+    unsigned char b = *l->p;
+    if ((b & 0xf0) == 0x90 || b == 0xdc || b == 0xdd) {
+        *lista = 1;
+        return leerCadenas(l, maximo, largoMaximo, destino, cantidad) && *cantidad > 0;
+    }
+    destino[0] = leerCadenaInSitu(l, &largo);
+    if (destino[0] == NULL || (largoMaximo != 0 && largo > largoMaximo)) {
+        return 0;
+    }
+    *cantidad = 1;
+    *lista = 0;
+    return 1;
+}
+
+// Cualquier entero o float64, como double (lo mismo que da cJSON para un número)
+static inline int leerNumero(Lector *l, double *numero) {
+    uint64_t valor;
+    if (l->p == l->fin) {
+        return 0;
+    }
+    unsigned char b = *l->p++;
+    if (b <= 0x7f) {
+        *numero = b;
+    } else if (b >= 0xe0) {
+        *numero = (double)((int)b - 256);
+    } else if (b >= 0xcc && b <= 0xcf) {
+        if (!leerEntero(l, 1 << (b - 0xcc), &valor)) {
+            return 0;
+        }
+        *numero = (double)valor;
+    } else if (b >= 0xd0 && b <= 0xd3) {
+        int bytes = 1 << (b - 0xd0);
+        if (!leerEntero(l, bytes, &valor)) {
+            return 0;
+        }
+        if (bytes < 8 && (valor >> (bytes * 8 - 1)) != 0) {
+            valor |= ~(uint64_t)0 << (bytes * 8);  // Extender el signo
+        }
+        *numero = (double)(int64_t)valor;
+    } else if (b == 0xcb) {
+        if (!leerEntero(l, 8, &valor)) {
+            return 0;
+        }
+        memcpy(numero, &valor, sizeof(*numero));
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Salta un valor cualquiera del subconjunto
+static inline int saltarValor(Lector *l, int profundidad) {
+    unsigned char *s;
+    size_t n;
+    uint64_t valor;
+
+    if (l->p == l->fin || profundidad > PROFUNDIDAD_BINARIA) {
+        return 0;
+    }
+    unsigned char b = *l->p;
+    if (b <= 0x7f || b >= 0xe0 || b == 0xc0 || b == 0xc2 || b == 0xc3) {
+        l->p++;  // fixint, nil, false, true
+        return 1;
+    }
+    if (b >= 0xcc && b <= 0xd3) {
+        l->p++;  // uint8..uint64, int8..int64
+        return leerEntero(l, 1 << ((b - 0xcc) & 3), &valor);
+    }
+    if (b == 0xcb) {
+        l->p++;
+        return leerEntero(l, 8, &valor);
+    }
+    if ((b & 0xe0) == 0xa0 || (b >= 0xd9 && b <= 0xdb)) {
+        return leerStr(l, &s, &n);
+    }
+    if ((b & 0xf0) == 0x90 || b == 0xdc || b == 0xdd) {
+        if (!leerArreglo(l, &n)) {
+            return 0;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (!saltarValor(l, profundidad + 1)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    if ((b & 0xf0) == 0x80 || b == 0xde || b == 0xdf) {
+        if (!leerMapa(l, &n)) {
+            return 0;
+        }
+        for (size_t i = 0; i < n; i++) {
+            size_t largoClave;
+            if (!leerStr(l, &s, &largoClave) || !saltarValor(l, profundidad + 1)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    return 0;  // bin, ext y float32 no son parte del protocolo
+}
+
+// Busca la clave en el mapa del marco sin modificarlo y deja valor al
+// inicio de su valor. 1 si está, 0 si no, -1 si el marco no es un mapa
+// bien formado.
+static inline int buscarValorBinario(unsigned char *marco, size_t largoMarco, const char *clave, Lector *valor) {
+    Lector l = { marco, marco + largoMarco };
+    size_t largoClave = strlen(clave);
+    size_t n;
+
+    if (!leerMapa(&l, &n)) {
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        unsigned char *k;
+        size_t lk;
+        if (!leerStr(&l, &k, &lk)) {
+            return -1;
+        }
+        if (lk == largoClave && memcmp(k, clave, lk) == 0) {
+            *valor = l;
+            return 1;
+        }
+        if (!saltarValor(&l, 1)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Igual, para una clave cuyo valor debe ser string: 0 también si no lo es
+static inline int buscarClaveBinaria(unsigned char *marco, size_t largoMarco, const char *clave,
+                                     const unsigned char **valor, size_t *largo) {
+    Lector l;
+    unsigned char *s;
+    int encontrada = buscarValorBinario(marco, largoMarco, clave, &l);
+
+    if (encontrada != 1) {
+        return encontrada;
+    }
+    if (!leerStr(&l, &s, largo)) {
+        return 0;
+    }
+    *valor = s;
+    return 1;
+}
+
+#endif
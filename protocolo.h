@@ -0,0 +1,515 @@
+/********************************************************
+ * protocolo.h
+ * Genera, a partir de protocolo.def, un struct por mensaje
+ * y sus funciones de lectura y serialización. La lectura
+ * va directo a las claves del esquema sobre el índice de
+ * la solicitud y deja los strings en el mismo buffer de
+ * entrada; la salida llena plantillas precompiladas. En
+ * ningún caso se arma un árbol cJSON. Los clientes que
+ * negocian la codificación binaria (binario.h) tienen su
+ * par de funciones: decodificar y codificar.
+ ********************************************************/
+#ifndef PROTOCOLO_H
+#define PROTOCOLO_H
+
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "ServerLocalWindows/cJSON.h"
+#include "binario.h"
+
+// Valor de un ENTERO que no vino
+#define SIN_ENTERO LONG_MIN
+
+typedef enum {
+#define MENSAJE(Nombre, clave, valor, error, campos) MSJ_##Nombre,
+#include "protocolo.def"
+#undef MENSAJE
+    NUM_MENSAJES  // Cuántos hay en el esquema
+} TipoMensaje;
+
+// Un struct por mensaje; los strings apuntan al buffer de la solicitud
+#define MENSAJE(Nombre, clave, valor, error, campos) \
+    typedef struct { TipoMensaje tipo; campos } Mensaje##Nombre;
+#define CAMPO(nombre, largoMaximo) const char *nombre;
+#define OPCIONAL(nombre, largoMaximo) const char *nombre;
+#define ENTERO(nombre, minimo, maximo) long nombre;
+#define CADENAS(nombre, maximo, largoMaximo) const char *nombre[maximo]; int num_##nombre;
+#define DESTINOS(nombre, maximo, largoMaximo) const char *nombre[maximo]; int num_##nombre; int lista_##nombre;
+#include "protocolo.def"
+#undef MENSAJE
+#undef CAMPO
+#undef OPCIONAL
+#undef ENTERO
+#undef CADENAS
+#undef DESTINOS
+
+// Cualquier mensaje del esquema; tipo dice cuál de los structs es
+typedef union {
+    TipoMensaje tipo;
+#define MENSAJE(Nombre, clave, valor, error, campos) Mensaje##Nombre Nombre;
+#include "protocolo.def"
+#undef MENSAJE
+} Mensaje;
+
+// Campos obligatorios de cada mensaje, terminados en NULL
+#define MENSAJE(Nombre, clave, valor, error, campos) \
+    static const char *const obligatorios##Nombre[] = { campos NULL };
+#define CAMPO(nombre, largoMaximo) #nombre,
+#define OPCIONAL(nombre, largoMaximo)
+#define ENTERO(nombre, minimo, maximo)
+#define CADENAS(nombre, maximo, largoMaximo)
+#define DESTINOS(nombre, maximo, largoMaximo)
+#include "protocolo.def"
+#undef MENSAJE
+#undef CAMPO
+#undef OPCIONAL
+#undef ENTERO
+#undef CADENAS
+#undef DESTINOS
+
+// Descripción de cada mensaje del esquema, indexada por TipoMensaje
+typedef struct {
+    const char *clave;                // "accion" o "tipo"
+    const char *nombre;               // Valor de la clave que lo identifica
+    const char *errorFormato;         // Razón si los campos no cumplen (NULL si no tiene)
+    const char *const *obligatorios;  // Campos que deben venir (los CAMPO)
+} DescripcionMensaje;
+
+static const DescripcionMensaje descripciones[] = {
+#define MENSAJE(Nombre, clave, valor, error, campos) { clave, valor, error, obligatorios##Nombre },
+#include "protocolo.def"
+#undef MENSAJE
+};
+
+// Lee un campo string del esquema; lo quita de escapes dentro del buffer
+static inline int leerCampo(const cJSON_Cursor *raiz, const char *clave, size_t largoMaximo,
+                            int obligatorio, const char **destino) {
+    cJSON_Cursor valor;
+    size_t largo = 0;
+
+    *destino = NULL;
+    if (!cJSON_CursorGetField(raiz, clave, &valor)) {
+        return !obligatorio;
+    }
+    *destino = cJSON_CursorGetStringInSitu(&valor, &largo);
+    if (*destino == NULL) {
+        return 0;
+    }
+    return largoMaximo == 0 || largo <= largoMaximo;
+}
+
+// Un ENTERO ya leído como número: sin decimales y dentro del rango
+static inline int enteroValido(double numero, long minimo, long maximo, long *destino) {
+    if (numero != floor(numero) || numero < (double)minimo || numero > (double)maximo) {
+        return 0;
+    }
+    *destino = (long)numero;
+    return 1;
+}
+
+static inline int leerCampoEntero(const cJSON_Cursor *raiz, const char *clave, long minimo, long maximo,
+                                  long *destino) {
+    cJSON_Cursor valor;
+    double numero = 0;
+
+    *destino = SIN_ENTERO;
+    if (!cJSON_CursorGetField(raiz, clave, &valor)) {
+        return 1;
+    }
+    return cJSON_CursorGetNumber(&valor, &numero) && enteroValido(numero, minimo, maximo, destino);
+}
+
+// Arreglo de strings; cada uno se quita de escapes dentro del buffer
+static inline int leerArregloCadenas(const cJSON_Cursor *arreglo, int maximo, size_t largoMaximo,
+                                     const char **destino, int *cantidad) {
+    cJSON_Cursor item;
+    size_t largo = 0;
+
+    *cantidad = 0;
+    if (cJSON_CursorType(arreglo) != cJSON_Array) {
+        return 0;
+    }
+    if (!cJSON_CursorGetFirstItem(arreglo, &item)) {
+        return 1;
+    }
+    do {
+        if (*cantidad == maximo) {
+            return 0;
+        }
+        destino[*cantidad] = cJSON_CursorGetStringInSitu(&item, &largo);
+        if (destino[*cantidad] == NULL || (largoMaximo != 0 && largo > largoMaximo)) {
+            return 0;
+        }
+        (*cantidad)++;
+    } while (cJSON_CursorGetNextItem(&item));
+    return 1;
+}
+
+static inline int leerCampoCadenas(const cJSON_Cursor *raiz, const char *clave, int maximo, size_t largoMaximo,
+                                   const char **destino, int *cantidad) {
+    cJSON_Cursor arreglo;
+
+    *cantidad = 0;
+    if (!cJSON_CursorGetField(raiz, clave, &arreglo)) {
+        return 1;
+    }
+    return leerArregloCadenas(&arreglo, maximo, largoMaximo, destino, cantidad);
+}
+
+// Un string, o un arreglo de 1 a maximo strings (lista dice cuál vino);
+// si no viene, cantidad queda en 0
+static inline int leerCampoDestinos(const cJSON_Cursor *raiz, const char *clave, int maximo, size_t largoMaximo,
+                                    const char **destino, int *cantidad, int *lista) {
+    cJSON_Cursor valor;
+    size_t largo = 0;
+
+    *cantidad = 0;
+    *lista = 0;
+    if (!cJSON_CursorGetField(raiz, clave, &valor)) {
+        return 1;
+    }
+    if (cJSON_CursorType(&valor) == cJSON_Array) {
+        *lista = 1;
+        return leerArregloCadenas(&valor, maximo, largoMaximo, destino, cantidad) && *cantidad > 0;
+    }
+    destino[0] = cJSON_CursorGetStringInSitu(&valor, &largo);
+    if (destino[0] == NULL || (largoMaximo != 0 && largo > largoMaximo)) {
+        return 0;
+    }
+    *cantidad = 1;
+    return 1;
+}
+
+// iniciarRegistro, iniciarDM, ...: todos los campos como si no hubieran venido
+#define MENSAJE(Nombre, clave, valor, error, campos) \
+    static inline void iniciar##Nombre(Mensaje##Nombre *m) { \
+        memset(m, 0, sizeof(*m)); \
+        m->tipo = MSJ_##Nombre; \
+        campos \
+    }
+#define CAMPO(nombre, largoMaximo)
+#define OPCIONAL(nombre, largoMaximo)
+#define ENTERO(nombre, minimo, maximo) m->nombre = SIN_ENTERO;
+#define CADENAS(nombre, maximo, largoMaximo)
+#define DESTINOS(nombre, maximo, largoMaximo)
+#include "protocolo.def"
+#undef MENSAJE
+#undef CAMPO
+#undef OPCIONAL
+#undef ENTERO
+#undef CADENAS
+#undef DESTINOS
+
+// leerRegistro, leerDM, ...: 1 si todos los campos cumplen el esquema
+#define MENSAJE(Nombre, clave, valor, error, campos) \
+    static inline int leer##Nombre(const cJSON_Cursor *raiz, Mensaje##Nombre *m) { \
+        (void)raiz; \
+        iniciar##Nombre(m); \
+        campos \
+        return 1; \
+    }
+#define CAMPO(nombre, largoMaximo) \
+        if (!leerCampo(raiz, #nombre, largoMaximo, 1, &m->nombre)) return 0;
+#define OPCIONAL(nombre, largoMaximo) \
+        if (!leerCampo(raiz, #nombre, largoMaximo, 0, &m->nombre)) return 0;
+#define ENTERO(nombre, minimo, maximo) \
+        if (!leerCampoEntero(raiz, #nombre, minimo, maximo, &m->nombre)) return 0;
+#define CADENAS(nombre, maximo, largoMaximo) \
+        if (!leerCampoCadenas(raiz, #nombre, maximo, largoMaximo, m->nombre, &m->num_##nombre)) return 0;
+#define DESTINOS(nombre, maximo, largoMaximo) \
+        if (!leerCampoDestinos(raiz, #nombre, maximo, largoMaximo, m->nombre, &m->num_##nombre, \
+                               &m->lista_##nombre)) return 0;
+#include "protocolo.def"
+#undef MENSAJE
+#undef CAMPO
+#undef OPCIONAL
+#undef ENTERO
+#undef CADENAS
+#undef DESTINOS
+
+/********************************************************
+* Plantillas de salida: el esqueleto de cada mensaje se
+* arma aquí en tiempo de compilación, con sangría (como
+* cJSON_Print) y compacto, y cada campo queda como un
+* hueco '$' que se llena con el valor ya escapado. Los
+* DESTINOS van en un hueco '@' con su JSON ya impreso.
+********************************************************/
+#define CAMPO(nombre, largoMaximo) ",\n\t\"" #nombre "\":\t$"
+#define OPCIONAL(nombre, largoMaximo) CAMPO(nombre, largoMaximo)
+#define ENTERO(nombre, minimo, maximo)
+#define CADENAS(nombre, maximo, largoMaximo)
+#define DESTINOS(nombre, maximo, largoMaximo) ",\n\t\"" #nombre "\":\t@"
+#define MENSAJE(Nombre, clave, valor, error, campos) \
+    "{\n\t\"" clave "\":\t\"" valor "\"" campos "\n}",
+static const char *const esqueletosConSangria[] = {
+#include "protocolo.def"
+};
+#undef CAMPO
+#undef DESTINOS
+#undef MENSAJE
+#define CAMPO(nombre, largoMaximo) ",\"" #nombre "\":$"
+#define DESTINOS(nombre, maximo, largoMaximo) ",\"" #nombre "\":@"
+#define MENSAJE(Nombre, clave, valor, error, campos) \
+    "{\"" clave "\":\"" valor "\"" campos "}",
+static const char *const esqueletosCompactos[] = {
+#include "protocolo.def"
+};
+#undef CAMPO
+#undef OPCIONAL
+#undef ENTERO
+#undef CADENAS
+#undef DESTINOS
+#undef MENSAJE
+
+// plantillas[tipo][compacto]
+static cJSON_Template *plantillas[NUM_MENSAJES][2];
+
+// Se compilan una vez, antes de atender clientes; 0 si falla alguna
+static inline int crearPlantillas(void) {
+    for (int i = 0; i < NUM_MENSAJES; i++) {
+        plantillas[i][0] = cJSON_CreateTemplate(esqueletosConSangria[i]);
+        plantillas[i][1] = cJSON_CreateTemplate(esqueletosCompactos[i]);
+        if (plantillas[i][0] == NULL || plantillas[i][1] == NULL) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Un DESTINOS como JSON para su hueco '@': un string, o el arreglo si
+// llegó como arreglo. Se imprime con cJSON sobre items en la pila (sin
+// armar un árbol en el heap) en un buffer del hilo.
+// Un arreglo sin nombres (solo lo arma el servidor: al leer se exige al
+// menos uno) deja HUECO_DESTINOS, un byte de control que en el resto del
+// texto siempre sale escapado; al enviar, cada destinatario recibe ahí su
+// propio nombre.
+#define MAX_DESTINOS 64  // Tope para el maximo de un DESTINOS del esquema
+#define HUECO_DESTINOS "\x01"
+
+static _Thread_local cJSON_PrintBuffer bufferDestinos;
+
+static inline const char *imprimirDestinos(const char *const *nombres, int cantidad, int lista, int compacto) {
+    cJSON arreglo, items[MAX_DESTINOS];
+    size_t largo = 0;
+
+    if (cantidad == 0 && lista) {
+        return HUECO_DESTINOS;
+    }
+    if (cantidad < 1 || cantidad > MAX_DESTINOS) {
+        return NULL;
+    }
+    memset(&arreglo, 0, sizeof(arreglo));
+    memset(items, 0, sizeof(items[0]) * (size_t)cantidad);
+    for (int i = 0; i < cantidad; i++) {
+        items[i].type = cJSON_String | cJSON_IsReference;
+        items[i].valuestring = (char *)nombres[i];
+        items[i].prev = &items[i > 0 ? i - 1 : cantidad - 1];
+        items[i].next = i + 1 < cantidad ? &items[i + 1] : NULL;
+    }
+    arreglo.type = cJSON_Array;
+    arreglo.child = &items[0];
+    return cJSON_PrintReusable(lista ? &arreglo : &items[0], !compacto, &bufferDestinos, &largo);
+}
+
+// serializarRegistro, serializarDM, ...: llena la plantilla del mensaje
+// en buffer y retorna el texto (largo bytes), o NULL si falla.
+// Un campo OPCIONAL que no vino sale como null.
+#define MENSAJE(Nombre, clave, valor, error, campos) \
+    static inline char *serializar##Nombre(const Mensaje##Nombre *m, int compacto, \
+                                           cJSON_PrintBuffer *buffer, size_t *largo) { \
+        const char *valores[] = { campos NULL }; \
+        (void)m; \
+        return cJSON_TemplateFill(plantillas[MSJ_##Nombre][compacto != 0], valores, buffer, largo); \
+    }
+#define CAMPO(nombre, largoMaximo) m->nombre,
+#define OPCIONAL(nombre, largoMaximo) m->nombre,
+#define ENTERO(nombre, minimo, maximo)
+#define CADENAS(nombre, maximo, largoMaximo)
+#define DESTINOS(nombre, maximo, largoMaximo) \
+        imprimirDestinos(m->nombre, m->num_##nombre, m->lista_##nombre, compacto),
+#include "protocolo.def"
+#undef MENSAJE
+#undef CAMPO
+#undef OPCIONAL
+#undef ENTERO
+#undef CADENAS
+#undef DESTINOS
+
+// Lee el mensaje del tipo indicado; 1 si cumple el esquema
+static inline int leerMensaje(TipoMensaje tipo, const cJSON_Cursor *raiz, Mensaje *m) {
+    switch (tipo) {
+#define MENSAJE(Nombre, clave, valor, error, campos) \
+        case MSJ_##Nombre: return leer##Nombre(raiz, &m->Nombre);
+#include "protocolo.def"
+#undef MENSAJE
+        default: return 0;
+    }
+}
+
+static inline char *serializarMensaje(const Mensaje *m, int compacto, cJSON_PrintBuffer *buffer, size_t *largo) {
+    switch (m->tipo) {
+#define MENSAJE(Nombre, clave, valor, error, campos) \
+        case MSJ_##Nombre: return serializar##Nombre(&m->Nombre, compacto, buffer, largo);
+#include "protocolo.def"
+#undef MENSAJE
+        default: return NULL;
+    }
+}
+
+/********************************************************
+* Codificación binaria: el mapa trae las mismas claves que
+* el JSON. Al decodificar se recorre el marco una sola vez;
+* las claves que no son del esquema se saltan, y un campo
+* repetido, un string demasiado largo o un byte sobrante
+* al final lo rechazan.
+********************************************************/
+// decodificarRegistro, decodificarDM, ...: marco sin los 4 bytes del largo
+#define MENSAJE(Nombre, clave, valor, error, campos) \
+    static inline int decodificar##Nombre(unsigned char *marco, size_t largoMarco, Mensaje##Nombre *m) { \
+        Lector l = { marco, marco + largoMarco }; \
+        size_t n = 0, vistos = 0; \
+        iniciar##Nombre(m); \
+        if (!leerMapa(&l, &n)) return 0; \
+        for (size_t i = 0; i < n; i++) { \
+            unsigned char *k; \
+            size_t lk = 0, lv = 0, maximo = 0; \
+            const char **destino = NULL; \
+            int obligatorio = 0; \
+            if (!leerStr(&l, &k, &lk)) return 0; \
+            campos { \
+                if (!saltarValor(&l, 1)) return 0; \
+                continue; \
+            } \
+            if (*destino != NULL) return 0; \
+            *destino = leerCadenaInSitu(&l, &lv); \
+            if (*destino == NULL || (maximo != 0 && lv > maximo)) return 0; \
+            vistos += (size_t)obligatorio; \
+        } \
+        return l.p == l.fin && \
+               vistos == sizeof(obligatorios##Nombre) / sizeof(obligatorios##Nombre[0]) - 1; \
+    }
+#define CAMPO(nombre, largoMaximo) \
+            if (lk == sizeof(#nombre) - 1 && memcmp(k, #nombre, lk) == 0) { \
+                destino = &m->nombre; maximo = largoMaximo; obligatorio = 1; \
+            } else
+#define OPCIONAL(nombre, largoMaximo) \
+            if (lk == sizeof(#nombre) - 1 && memcmp(k, #nombre, lk) == 0) { \
+                destino = &m->nombre; maximo = largoMaximo; \
+            } else
+#define ENTERO(nombre, minimo, maximo) \
+            if (lk == sizeof(#nombre) - 1 && memcmp(k, #nombre, lk) == 0) { \
+                double numero; \
+                if (m->nombre != SIN_ENTERO || !leerNumero(&l, &numero) || \
+                    !enteroValido(numero, minimo, maximo, &m->nombre)) return 0; \
+                continue; \
+            } else
+#define CADENAS(nombre, maximo, largoMaximo) \
+            if (lk == sizeof(#nombre) - 1 && memcmp(k, #nombre, lk) == 0) { \
+                if (m->num_##nombre != 0 || \
+                    !leerCadenas(&l, maximo, largoMaximo, m->nombre, &m->num_##nombre)) return 0; \
+                continue; \
+            } else
+#define DESTINOS(nombre, maximo, largoMaximo) \
+            if (lk == sizeof(#nombre) - 1 && memcmp(k, #nombre, lk) == 0) { \
+                if (m->num_##nombre != 0 || \
+                    !leerDestinos(&l, maximo, largoMaximo, m->nombre, &m->num_##nombre, \
+                                  &m->lista_##nombre)) return 0; \
+                continue; \
+            } else
+#include "protocolo.def"
+#undef MENSAJE
+#undef CAMPO
+#undef OPCIONAL
+#undef ENTERO
+#undef CADENAS
+#undef DESTINOS
+
+// Par clave/string del mapa, si el campo vino (un OPCIONAL ausente no se escribe)
+static inline void escribirCampo(Escritor *e, const char *nombre, const char *valor, size_t *n) {
+    if (valor != NULL) {
+        escribirCadena(e, nombre);
+        escribirCadena(e, valor);
+        (*n)++;
+    }
+}
+
+// Par clave/DESTINOS: un string, o el arreglo si llegó como arreglo
+static inline void escribirDestinos(Escritor *e, const char *nombre, const char *const *nombres,
+                                    int cantidad, int lista, size_t *n) {
+    if (cantidad == 0) {
+        return;
+    }
+    escribirCadena(e, nombre);
+    if (lista) {
+        escribirArreglo(e, (size_t)cantidad);
+        for (int i = 0; i < cantidad; i++) {
+            escribirCadena(e, nombres[i]);
+        }
+    } else {
+        escribirCadena(e, nombres[0]);
+    }
+    (*n)++;
+}
+
+// codificarRegistro, codificarDM, ...: marco completo (largo incluido) en
+// buffer, con "verificado":true primero si se pide, o NULL si falla.
+// El mapa va siempre con 16 bits de largo para llenarlo al final.
+#define MENSAJE(Nombre, clave, valor, error, campos) \
+    static inline char *codificar##Nombre(const Mensaje##Nombre *m, int verificado, \
+                                          cJSON_PrintBuffer *buffer, size_t *largo) { \
+        Escritor e = { buffer, 0, 0 }; \
+        size_t n = 1; \
+        (void)m; \
+        reservar(&e, LARGO_MARCO + 3); \
+        if (verificado) { \
+            escribirCadena(&e, "verificado"); \
+            escribirBool(&e, 1); \
+            n++; \
+        } \
+        escribirCadena(&e, clave); \
+        escribirCadena(&e, valor); \
+        campos \
+        if (e.fallo) return NULL; \
+        escribirLargoMarco((unsigned char *)buffer->buffer, e.largo - LARGO_MARCO); \
+        buffer->buffer[LARGO_MARCO] = (char)0xde; \
+        buffer->buffer[LARGO_MARCO + 1] = (char)(n >> 8); \
+        buffer->buffer[LARGO_MARCO + 2] = (char)n; \
+        *largo = e.largo; \
+        return buffer->buffer; \
+    }
+#define CAMPO(nombre, largoMaximo) escribirCampo(&e, #nombre, m->nombre, &n);
+#define OPCIONAL(nombre, largoMaximo) CAMPO(nombre, largoMaximo)
+#define ENTERO(nombre, minimo, maximo)
+#define CADENAS(nombre, maximo, largoMaximo)
+#define DESTINOS(nombre, maximo, largoMaximo) \
+        escribirDestinos(&e, #nombre, m->nombre, m->num_##nombre, m->lista_##nombre, &n);
+#include "protocolo.def"
+#undef MENSAJE
+#undef CAMPO
+#undef OPCIONAL
+#undef ENTERO
+#undef CADENAS
+#undef DESTINOS
+
+static inline int decodificarMensaje(TipoMensaje tipo, unsigned char *marco, size_t largoMarco, Mensaje *m) {
+    switch (tipo) {
+#define MENSAJE(Nombre, clave, valor, error, campos) \
+        case MSJ_##Nombre: return decodificar##Nombre(marco, largoMarco, &m->Nombre);
+#include "protocolo.def"
+#undef MENSAJE
+        default: return 0;
+    }
+}
+
+static inline char *codificarMensaje(const Mensaje *m, int verificado, cJSON_PrintBuffer *buffer, size_t *largo) {
+    switch (m->tipo) {
+#define MENSAJE(Nombre, clave, valor, error, campos) \
+        case MSJ_##Nombre: return codificar##Nombre(&m->Nombre, verificado, buffer, largo);
+#include "protocolo.def"
+#undef MENSAJE
+        default: return NULL;
+    }
+}
+
+#endif
@@ -0,0 +1,398 @@
+/********************************************************
+ * pruebas.c
+ * Pruebas de lo que se le agregó a cJSON para el
+ * servidor; cada parte tiene su función. Los casos al
+ * azar usan una semilla fija, así una falla se repite.
+ * Termina con 1 si alguna prueba falla.
+ *
+ * Compilación:
+ *   gcc -O2 pruebas.c ServerLocalWindows/cJSON.c -o pruebas -lm
+ ********************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "ServerLocalWindows/cJSON.h"
+
+#define CASOS_NUMEROS 200000
+#define CASOS_MUTADOS 200000
+
+static int fallas = 0;
+
+#define VERIFICAR(condicion, ...) do { \
+        if (!(condicion)) { \
+            fallas++; \
+            printf("FALLA %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+        } \
+    } while (0)
+
+// xorshift64: cada corrida ve los mismos casos
+static uint64_t semilla = 0x9E3779B97F4A7C15ULL;
+
+uint64_t azar(void) {
+    semilla ^= semilla << 13;
+    semilla ^= semilla >> 7;
+    semilla ^= semilla << 17;
+    return semilla;
+}
+
+// Imprime un número solo, sin formato, en texto (de tamaño fijo)
+void imprimirNumero(double d, char *texto, size_t largo) {
+    cJSON *item = cJSON_CreateNumber(d);
+    char *impreso = cJSON_PrintUnformatted(item);
+    snprintf(texto, largo, "%s", impreso != NULL ? impreso : "(null)");
+    free(impreso);
+    cJSON_Delete(item);
+}
+
+/********************************************************
+* Impresión de números: cada double finito se imprime
+* con los dígitos justos para volver al mismo double, y
+* los enteros menores que 2^53 salen completos.
+********************************************************/
+void probarImpresion(void) {
+    static const struct {
+        double valor;
+        const char *texto;
+    } conocidos[] = {
+        { 0.1, "0.1" },
+        { 1.5, "1.5" },
+        { -5, "-5" },
+        { 4.35, "4.35" },
+        { 0.000123, "0.000123" },
+        { 123456789012, "123456789012" },
+        { 1879388476932112.0, "1879388476932112" },  // Más de 10^15: sin exponente
+        { 9007199254740991.0, "9007199254740991" },  // 2^53 - 1
+        { 1e300, "1e+300" },
+        { 5e-324, "5e-324" },
+    };
+    char texto[64];
+
+    for (size_t i = 0; i < sizeof(conocidos) / sizeof(conocidos[0]); i++) {
+        imprimirNumero(conocidos[i].valor, texto, sizeof(texto));
+        VERIFICAR(strcmp(texto, conocidos[i].texto) == 0,
+                  "%.17g se imprimió como %s y no %s", conocidos[i].valor, texto, conocidos[i].texto);
+    }
+
+    for (int i = 0; i < CASOS_NUMEROS; i++) {
+        uint64_t bits = azar();
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        if (!isfinite(d)) {
+            continue;
+        }
+
+        imprimirNumero(d, texto, sizeof(texto));
+        cJSON *leido = cJSON_Parse(texto);
+        VERIFICAR(leido != NULL && cJSON_IsNumber(leido) && leido->valuedouble == d,
+                  "%.17g se imprimió como %s y no vuelve al mismo double", d, texto);
+        cJSON_Delete(leido);
+    }
+}
+
+/********************************************************
+* Lectura de números: el parser da el mismo double que
+* strtod, por el camino rápido y por el lento.
+********************************************************/
+void probarLectura(void) {
+    static const char *const conocidos[] = {
+        "0", "-0", "1e22", "1e23", "9007199254740993", "0.1", "2.2250738585072011e-308",
+        "4.9406564584124654e-324", "1.7976931348623157e308", "123456789012345678901234567890",
+    };
+    char decimal[64];
+
+    for (size_t i = 0; i < sizeof(conocidos) / sizeof(conocidos[0]); i++) {
+        cJSON *leido = cJSON_Parse(conocidos[i]);
+        VERIFICAR(leido != NULL && leido->valuedouble == strtod(conocidos[i], NULL),
+                  "%s se leyó como %.17g", conocidos[i], leido ? leido->valuedouble : 0);
+        cJSON_Delete(leido);
+    }
+
+    for (int i = 0; i < CASOS_NUMEROS; i++) {
+        // Hasta 19 dígitos, con o sin decimales, con exponente
+        uint64_t bits = azar();
+        snprintf(decimal, sizeof(decimal), "%s%llu%se%d", (bits & 1) ? "-" : "",
+                 (unsigned long long)(azar() % 10000000000000000000ULL),
+                 (bits & 2) ? ".5" : "", (int)(azar() % 80) - 40);
+        cJSON *leido = cJSON_Parse(decimal);
+        VERIFICAR(leido != NULL && leido->valuedouble == strtod(decimal, NULL),
+                  "%s se leyó como %.17g y no %.17g", decimal, leido ? leido->valuedouble : 0, strtod(decimal, NULL));
+        cJSON_Delete(leido);
+    }
+}
+
+/********************************************************
+* Flujo: los documentos seguidos (con espacios entre
+* ellos) terminan donde deben sin importar en cuántos
+* pedazos lleguen.
+********************************************************/
+static const char *const documentos[] = {
+    "{\"accion\":\"DM\",\"nombre_emisor\":\"Cindy\",\"nombre_destinatario\":\"Pablo\",\"mensaje\":\"hola\"}",
+    "{\"tipo\":\"REGISTRO\",\"usuario\":\"ana\",\"direccionIP\":\"1.2.3.4\",\"capacidades\":[\"COMPACTO\",\"LOTES\"],\"version\":2}",
+    "{\"accion\":\"BATCH\",\"solicitudes\":[{\"accion\":\"LISTA\"},{\"tipo\":\"MOSTRAR\",\"usuario\":\"b\\u00f1\"}],\"id\":-12.5e3}",
+    "[true,false,null,0,-0.0,1e-7,{\"\\\"\":\"\\\\\\/\\b\\f\\n\\r\\t\"},[[]],{}]",
+    "{\"mensaje\":\"ñandú \\ud83d\\ude00 \\u0000\",\"a\":{\"b\":{\"c\":[1,2,3]}}}",
+};
+#define NUM_DOCUMENTOS (int)(sizeof(documentos) / sizeof(documentos[0]))
+
+// Pasa texto al flujo en pedazos que terminan en cortes[]; anota dónde
+// termina cada documento. Retorna cuántos terminaron, -1 si hubo error.
+int escanear(const char *texto, size_t largo, const size_t *cortes, int numCortes, size_t *finales) {
+    cJSON_Stream *flujo = cJSON_CreateStream();
+    size_t inicio = 0;
+    int terminados = 0;
+
+    for (int c = 0; c <= numCortes; c++) {
+        size_t fin = c < numCortes ? cortes[c] : largo;
+        while (inicio < fin) {
+            size_t usados = 0;
+            cJSON_bool completo = 0;
+            if (!cJSON_StreamScan(flujo, texto + inicio, fin - inicio, &usados, &completo)) {
+                cJSON_DeleteStream(flujo);
+                return -1;
+            }
+            inicio += usados;
+            if (completo) {
+                finales[terminados++] = inicio;
+            }
+        }
+    }
+    if (!cJSON_StreamIsIdle(flujo)) {
+        terminados = -1;
+    }
+    cJSON_DeleteStream(flujo);
+    return terminados;
+}
+
+void probarFlujo(void) {
+    char texto[2048];
+    size_t esperados[NUM_DOCUMENTOS + 1], finales[NUM_DOCUMENTOS + 1], cortes[8];
+    size_t largo = 0;
+
+    for (int i = 0; i < NUM_DOCUMENTOS; i++) {
+        largo += (size_t)sprintf(texto + largo, "%s", i % 2 ? "\r\n" : " ");
+        largo += (size_t)sprintf(texto + largo, "%s", documentos[i]);
+        esperados[i] = largo;
+    }
+    texto[largo++] = '\n';
+
+    // Un corte en cada posición, y después varios al azar
+    for (size_t corte = 0; corte <= largo; corte++) {
+        int n = escanear(texto, largo, &corte, 1, finales);
+        VERIFICAR(n == NUM_DOCUMENTOS && memcmp(finales, esperados, sizeof(size_t) * NUM_DOCUMENTOS) == 0,
+                  "cortado en %zu: %d documentos", corte, n);
+    }
+    for (int i = 0; i < 20000; i++) {
+        int numCortes = 1 + (int)(azar() % 8);
+        for (int c = 0; c < numCortes; c++) {
+            cortes[c] = (size_t)(azar() % (largo + 1));
+        }
+        for (int c = 1; c < numCortes; c++) {  // En orden
+            for (int k = c; k > 0 && cortes[k - 1] > cortes[k]; k--) {
+                size_t t = cortes[k];
+                cortes[k] = cortes[k - 1];
+                cortes[k - 1] = t;
+            }
+        }
+        int n = escanear(texto, largo, cortes, numCortes, finales);
+        VERIFICAR(n == NUM_DOCUMENTOS && memcmp(finales, esperados, sizeof(size_t) * NUM_DOCUMENTOS) == 0,
+                  "con %d cortes: %d documentos", numCortes, n);
+    }
+
+    // Entre documentos solo van espacios
+    VERIFICAR(escanear("{} x", 4, NULL, 0, finales) == -1, "se aceptó una x entre documentos");
+    VERIFICAR(escanear("{} \"", 4, NULL, 0, finales) == -1, "se aceptó una comilla suelta");
+    VERIFICAR(escanear("}", 1, NULL, 0, finales) == -1, "se aceptó un cierre sin abrir");
+}
+
+/********************************************************
+* Índice: cada campo que el cursor encuentra tiene el
+* tipo y el valor que da el árbol.
+********************************************************/
+
+// Con claves repetidas los dos toman la primera, sin distinguir mayúsculas
+int mismosCampos(cJSON_Index *indice, const char *texto, size_t largo, const cJSON *arbol) {
+    cJSON_Cursor raiz, valor;
+    if (!cJSON_IndexBuild(indice, texto, largo, &raiz)) {
+        return 0;
+    }
+    if (!cJSON_IsObject(arbol)) {
+        return cJSON_CursorType(&raiz) == (arbol->type & 0xFF);
+    }
+    for (const cJSON *campo = arbol->child; campo != NULL; campo = campo->next) {
+        const cJSON *primero = cJSON_GetObjectItem(arbol, campo->string);
+        if (!cJSON_CursorGetField(&raiz, campo->string, &valor) ||
+            cJSON_CursorType(&valor) != (primero->type & 0xFF)) {
+            return 0;
+        }
+        cJSON *leido = cJSON_CursorParse(&valor, 0);
+        int igual = cJSON_Compare(leido, primero, 1);
+        cJSON_Delete(leido);
+        if (!igual) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void probarIndice(void) {
+    cJSON_Index *indice = cJSON_CreateIndex();
+    cJSON_Cursor raiz, valor;
+
+    for (int i = 0; i < NUM_DOCUMENTOS; i++) {
+        cJSON *arbol = cJSON_Parse(documentos[i]);
+        VERIFICAR(arbol != NULL && mismosCampos(indice, documentos[i], strlen(documentos[i]), arbol),
+                  "el índice no coincide con el árbol en el documento %d", i);
+        cJSON_Delete(arbol);
+    }
+
+    static const char repetidos[] = "{\"a\":1,\"A\":\"dos\",\"a\":[3]}";
+    VERIFICAR(cJSON_IndexBuild(indice, repetidos, strlen(repetidos), &raiz) &&
+              cJSON_CursorGetField(&raiz, "a", &valor) && cJSON_CursorType(&valor) == cJSON_Number,
+              "con claves repetidas no se tomó la primera");
+    VERIFICAR(!cJSON_CursorGetField(&raiz, "b", &valor), "se encontró un campo que no está");
+    cJSON_DeleteIndex(indice);
+}
+
+/********************************************************
+* Validación: cJSON_Validate acepta lo mismo que el
+* parser estricto, también con documentos mutados al azar.
+********************************************************/
+void probarValidacion(void) {
+    static const struct {
+        const char *texto;
+        int valido;
+    } casos[] = {
+        { "{}", 1 },
+        { " [1, 2] \n", 1 },
+        { "\"solo un string\"", 1 },
+        { "{\"a\":1,}", 0 },
+        { "[1,]", 0 },
+        { "{\"a\" 1}", 0 },
+        { "[01]", 0 },
+        { "[1.]", 0 },
+        { "[.5]", 0 },
+        { "[\"\\x\"]", 0 },
+        { "[\"\\ud800\"]", 0 },
+        { "[\"\x01\"]", 0 },
+        { "[\"\xc3\x28\"]", 0 },
+        { "[\"\xed\xa0\x80\"]", 0 },
+        { "{} {}", 0 },
+        { "[tru]", 0 },
+        { "{\"a\":[}", 0 },
+    };
+    cJSON_Index *indice = cJSON_CreateIndex();
+
+    for (size_t i = 0; i < sizeof(casos) / sizeof(casos[0]); i++) {
+        VERIFICAR(cJSON_Validate(casos[i].texto, strlen(casos[i].texto)) == casos[i].valido,
+                  "cJSON_Validate(%s) debía dar %d", casos[i].texto, casos[i].valido);
+    }
+
+    // Documentos válidos con bytes cambiados, agregados o quitados
+    char texto[512];
+    int aceptados = 0;
+    for (int i = 0; i < CASOS_MUTADOS; i++) {
+        const char *original = documentos[azar() % NUM_DOCUMENTOS];
+        size_t largo = strlen(original);
+        memcpy(texto, original, largo);
+        for (int cambios = 1 + (int)(azar() % 3); cambios > 0; cambios--) {
+            size_t pos = (size_t)(azar() % largo);
+            static const char interesantes[] = "{}[]\":,\\ 0-.eEuatfn\x80\xc3";
+            char byte = (azar() & 1) ? interesantes[azar() % (sizeof(interesantes) - 1)]
+                                     : (char)(1 + azar() % 255);
+            switch (azar() % 3) {
+                case 0:
+                    texto[pos] = byte;
+                    break;
+                case 1:
+                    memmove(texto + pos + 1, texto + pos, largo - pos);
+                    texto[pos] = byte;
+                    largo++;
+                    break;
+                default:
+                    if (largo > 1) {
+                        memmove(texto + pos, texto + pos + 1, largo - pos - 1);
+                        largo--;
+                    }
+                    break;
+            }
+        }
+        texto[largo] = '\0';
+
+        if (!cJSON_Validate(texto, largo)) {
+            continue;
+        }
+        aceptados++;
+        cJSON *arbol = cJSON_ParseWithLengthOpts(texto, largo + 1, NULL, 1);  // El largo cuenta el '\0'
+        VERIFICAR(arbol != NULL, "cJSON_Validate aceptó lo que el parser rechaza: %s", texto);
+        VERIFICAR(arbol == NULL || mismosCampos(indice, texto, largo, arbol),
+                  "el índice no coincide con el árbol: %s", texto);
+        cJSON_Delete(arbol);
+    }
+    VERIFICAR(aceptados > 0, "ninguna mutación fue válida");
+
+    for (int i = 0; i < NUM_DOCUMENTOS; i++) {
+        size_t largo = strlen(documentos[i]);
+        cJSON *arbol = cJSON_Parse(documentos[i]);
+        VERIFICAR(cJSON_Validate(documentos[i], largo) && arbol != NULL &&
+                  mismosCampos(indice, documentos[i], largo, arbol), "el documento %d no pasa", i);
+        cJSON_Delete(arbol);
+    }
+    cJSON_DeleteIndex(indice);
+}
+
+/********************************************************
+* Plantillas: lo llenado es JSON, cada string vuelve
+* tal cual y lo de un espacio '@' se copia sin cambios.
+********************************************************/
+void probarPlantillas(void) {
+    cJSON_Template *plantilla = cJSON_CreateTemplate("{\"accion\":\"DM\",\"nombre_emisor\":$,\"mensaje\":$,\"extra\":@}");
+    cJSON_PrintBuffer buffer = { NULL, 0 };
+    static const char *const mensajes[] = {
+        "", "hola", "comillas \" y barra \\ y / ", "control \x01\x1f\t\n", "ñandú 😀", "$ @ {\"no\":\"es espacio\"}",
+    };
+
+    VERIFICAR(plantilla != NULL && cJSON_TemplateSlotCount(plantilla) == 3, "la plantilla no tiene 3 espacios");
+    for (size_t i = 0; plantilla != NULL && i < sizeof(mensajes) / sizeof(mensajes[0]); i++) {
+        const char *valores[3] = { i % 2 ? NULL : "Cindy", mensajes[i], "[1,{\"a\":2}]" };
+        size_t largo = 0;
+        const char *texto = cJSON_TemplateFill(plantilla, valores, &buffer, &largo);
+        cJSON *leido = texto != NULL ? cJSON_ParseWithLength(texto, largo) : NULL;
+        VERIFICAR(leido != NULL, "la plantilla dio JSON inválido: %s", texto);
+        if (leido == NULL) {
+            continue;
+        }
+        // El servidor marca con un byte de control el hueco de los DM a varios
+        VERIFICAR(memchr(texto, '\x01', largo) == NULL, "un byte de control quedó sin escapar: %s", texto);
+        const cJSON *emisor = cJSON_GetObjectItemCaseSensitive(leido, "nombre_emisor");
+        VERIFICAR(i % 2 ? cJSON_IsNull(emisor) : (cJSON_IsString(emisor) && strcmp(emisor->valuestring, "Cindy") == 0),
+                  "nombre_emisor mal llenado: %s", texto);
+        const cJSON *mensaje = cJSON_GetObjectItemCaseSensitive(leido, "mensaje");
+        VERIFICAR(cJSON_IsString(mensaje) && strcmp(mensaje->valuestring, mensajes[i]) == 0,
+                  "el mensaje %zu no volvió igual: %s", i, texto);
+        VERIFICAR(cJSON_GetArraySize(cJSON_GetObjectItemCaseSensitive(leido, "extra")) == 2,
+                  "el espacio @ no se copió tal cual: %s", texto);
+        cJSON_Delete(leido);
+    }
+    cJSON_FreePrintBuffer(&buffer);
+    cJSON_DeleteTemplate(plantilla);
+}
+
+int main() {
+    probarImpresion();
+    probarLectura();
+    probarFlujo();
+    probarIndice();
+    probarValidacion();
+    probarPlantillas();
+
+    if (fallas > 0) {
+        printf("%d fallas\n", fallas);
+        return 1;
+    }
+    printf("Todas las pruebas pasaron\n");
+    return 0;
+}
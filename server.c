@@ -1,25 +1,43 @@
 /********************************************************
  * server.c
  * Servidor multihilo con desconexión por inactividad
+ *
+ * Compilación:
+ *   gcc server.c ServerLocalWindows/cJSON.c -o server -lpthread -lm
  ********************************************************/
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <cjson/cJSON.h>
+#include <sys/uio.h>
+#include "ServerLocalWindows/cJSON.h"
+#include "protocolo.h"
 #include <ctype.h>
 #include <time.h>
+#include <stdatomic.h>
 
 #define PORT 50213
 #define BACKLOG 10
 #define BUFSIZE 1024
-#define MAX_CLIENTS 10
+#define MAX_SOLICITUD 65536       // Tamaño máximo de un JSON (o marco binario) recibido
+#define BLOQUE_ENVIO 4096         // Bytes por send al escribir una respuesta grande mientras se imprime
+#define MAX_CLIENTS 10            // Hasta 64: los canales guardan a sus miembros en un bitmap
+#define MAX_CANALES 32
+#define MAX_OBSERVADOS 256        // Usuarios distintos con suscriptores de presencia
+#define VENTANA_PRESENCIA_MS 500  // Los cambios de estado de un usuario se juntan durante este tiempo (ver main)
 #define TIEMPO_INACTIVIDAD 60    // 60 segundos de inactividad
 #define INTERVALO_VERIFICACION 10 // Verificar cada 10 segundos
+#define REENVIO_DIRECTO 1         // DM/BROADCAST se reenvían con los bytes recibidos (0 = se rearman con plantillas)
+#define VERSION_PROTOCOLO 2       // 1 = REGISTRO sin "version" ni "capacidades" (client.c)
+#define ID_MAXIMO 9007199254740991L  // 2^53 - 1: un "id" que se representa exacto como double
+#define MAX_PENDIENTE 16384       // Respuestas acumuladas con PIPELINE antes de mandarlas igual
+#define MAX_CAMBIOS 256           // Altas y bajas que se recuerdan para los LISTA con "desde_version"
+#define LIMITE_BUSQUEDA 20        // Resultados de un BUSCAR que no manda "limite"
 
 void strToUpper(char *dest, const char *src) {
     while (*src) {
@@ -30,6 +48,38 @@ void strToUpper(char *dest, const char *src) {
     *dest = '\0';
 }
 
+// Formato negociado en el REGISTRO con "formato"; sin él, JSON con sangría
+typedef enum {
+    FORMATO_SANGRIA,
+    FORMATO_COMPACTO,
+    FORMATO_BINARIO,   // Marcos MessagePack (binario.h) en ambos sentidos
+    NUM_FORMATOS
+} FormatoSalida;
+
+// Capacidades que un cliente puede pedir en el REGISTRO ("capacidades")
+typedef enum {
+    CAP_COMPACTO   = 1 << 0,  // JSON sin sangría
+    CAP_BINARIO    = 1 << 1,  // Marcos MessagePack (binario.h)
+    CAP_COMPRESION = 1 << 2,
+    CAP_LOTES      = 1 << 3,
+    CAP_PIPELINE   = 1 << 4
+} Capacidad;
+
+static const struct {
+    const char *nombre;
+    Capacidad bit;
+} nombresCapacidades[] = {
+    { "COMPACTO",   CAP_COMPACTO },
+    { "BINARIO",    CAP_BINARIO },
+    { "COMPRESION", CAP_COMPRESION },
+    { "LOTES",      CAP_LOTES },
+    { "PIPELINE",   CAP_PIPELINE },
+};
+#define NUM_CAPACIDADES (int)(sizeof(nombresCapacidades) / sizeof(nombresCapacidades[0]))
+
+// Las que este servidor implementa: se otorga lo pedido que esté aquí
+#define CAPACIDADES_SERVIDOR (CAP_COMPACTO | CAP_BINARIO | CAP_LOTES | CAP_PIPELINE)
+
 typedef struct {
     int socketFD;
     char nombre[50];
@@ -37,17 +87,366 @@ typedef struct {
     char status[10];
     time_t ultimaActividad;
     int activo;
+    FormatoSalida formato;
+    long id;  // Id numérico que le da el REGISTRO (ver buscarId)
 } Cliente;
 
 static Cliente clientesConectados[MAX_CLIENTS];
 static pthread_mutex_t clientesMutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Un BATCH toma clientesMutex una vez para todas sus solicitudes; mientras
+// tanto los manejadores que se pueden incluir en él no lo vuelven a tomar
+static _Thread_local int mutexDelLote;
+
+void tomarClientes(void) {
+    if (!mutexDelLote) {
+        pthread_mutex_lock(&clientesMutex);
+    }
+}
+
+void soltarClientes(void) {
+    if (!mutexDelLote) {
+        pthread_mutex_unlock(&clientesMutex);
+    }
+}
+
+/********************************************************
+* Canales: cada uno guarda a sus miembros como un bitmap
+* de posiciones de clientesConectados, así un CHANNEL_MSG
+* recorre solo los bits encendidos y no a todos los
+* clientes. Se crean con el primer JOIN y desaparecen con
+* el último LEAVE. Se protegen con clientesMutex.
+********************************************************/
+#if MAX_CLIENTS > 64
+#error "Los miembros de un canal son un bitmap de 64 bits"
+#endif
+
+typedef struct {
+    char nombre[32];    // "" si la posición está libre
+    uint64_t miembros;  // Bit i: clientesConectados[i] está en el canal
+} Canal;
+
+static Canal canales[MAX_CANALES];
+
+// Se llama con clientesMutex tomado; NULL si no existe y no se pide crear
+// (o ya no hay lugar)
+Canal *buscarCanal(const char *nombre, int crear) {
+    Canal *libre = NULL;
+    for (int i = 0; i < MAX_CANALES; i++) {
+        if (canales[i].nombre[0] == '\0') {
+            if (libre == NULL) {
+                libre = &canales[i];
+            }
+        } else if (strcmp(canales[i].nombre, nombre) == 0) {
+            return &canales[i];
+        }
+    }
+    if (!crear || libre == NULL) {
+        return NULL;
+    }
+    strcpy(libre->nombre, nombre);
+    libre->miembros = 0;
+    return libre;
+}
+
+// Saca una posición de clientesConectados de todos sus canales
+void dejarCanales(int indice) {
+    for (int i = 0; i < MAX_CANALES; i++) {
+        canales[i].miembros &= ~((uint64_t)1 << indice);
+        if (canales[i].miembros == 0) {
+            canales[i].nombre[0] = '\0';
+        }
+    }
+}
+
+/********************************************************
+* Presencia: con SUSCRIBIR un cliente pide los cambios de
+* estado de una lista de usuarios. Cada usuario observado
+* guarda a sus suscriptores en un bitmap, como un canal.
+* Un cambio solo lo marca pendiente y, si es el primero,
+* programa una publicación una ventana después;
+* en ella se manda el estado de ese momento de todos los
+* pendientes, en un solo PRESENCIA por suscriptor. Un
+* ACTIVO/INACTIVO que va y vuelve dentro de la ventana no
+* manda nada, y nadie genera más de un aviso por ventana.
+********************************************************/
+typedef struct {
+    char nombre[50];        // "" si la posición está libre
+    uint64_t suscriptores;  // Bit i: clientesConectados[i] lo observa
+    char publicado[16];     // Último estado que se les mandó
+    int pendiente;          // Cambió desde la última publicación
+} Observado;
+
+static Observado observados[MAX_OBSERVADOS];
+static long ventanaPresencia = VENTANA_PRESENCIA_MS;  // En milisegundos
+static long long proximaPublicacion;  // En milisegundos; 0 si no hay cambios pendientes
+static pthread_cond_t presenciaCond = PTHREAD_COND_INITIALIZER;
+
+long long milisegundos(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+// Lo que se publica de un usuario; se llama con clientesMutex tomado
+const char *estadoPresencia(const char *nombre) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clientesConectados[i].activo == 1 && strcmp(clientesConectados[i].nombre, nombre) == 0) {
+            return clientesConectados[i].status;
+        }
+    }
+    return "DESCONECTADO";
+}
+
+// Se llama con clientesMutex tomado; NULL si no existe y no se pide crear
+// (o ya no hay lugar)
+Observado *buscarObservado(const char *nombre, int crear) {
+    Observado *libre = NULL;
+    for (int i = 0; i < MAX_OBSERVADOS; i++) {
+        if (observados[i].nombre[0] == '\0') {
+            if (libre == NULL) {
+                libre = &observados[i];
+            }
+        } else if (strcmp(observados[i].nombre, nombre) == 0) {
+            return &observados[i];
+        }
+    }
+    if (!crear || libre == NULL) {
+        return NULL;
+    }
+    strcpy(libre->nombre, nombre);
+    strcpy(libre->publicado, estadoPresencia(nombre));
+    libre->suscriptores = 0;
+    libre->pendiente = 0;
+    return libre;
+}
+
+// El estado del usuario cambió (o se conectó o desconectó); se llama con
+// clientesMutex tomado
+void notificarPresencia(const char *nombre) {
+    Observado *o = buscarObservado(nombre, 0);
+    if (o == NULL) {
+        return;
+    }
+    o->pendiente = 1;
+    if (proximaPublicacion == 0) {
+        proximaPublicacion = milisegundos() + ventanaPresencia;
+        pthread_cond_signal(&presenciaCond);
+    }
+}
+
+// Todo cambio de status pasa por aquí; se llama con clientesMutex tomado
+void cambiarEstado(int indice, const char *estado) {
+    if (strcmp(clientesConectados[indice].status, estado) != 0) {
+        strcpy(clientesConectados[indice].status, estado);
+        notificarPresencia(clientesConectados[indice].nombre);
+    }
+}
+
+// Saca una posición de clientesConectados de todas sus suscripciones
+void dejarObservados(int indice) {
+    for (int i = 0; i < MAX_OBSERVADOS; i++) {
+        observados[i].suscriptores &= ~((uint64_t)1 << indice);
+        if (observados[i].suscriptores == 0) {
+            observados[i].nombre[0] = '\0';
+        }
+    }
+}
+
+/********************************************************
+* Envío: cada mensaje sale entero con el candado de su
+* socket. Además del hilo del cliente escriben en él los
+* reenvíos de otros hilos y el de presencia; sin el
+* candado sus bytes se podrían mezclar con una respuesta.
+* Los sockets se reparten entre CANDADOS_ENVIO candados
+* por número, así uno lento solo frena a los que le tocan.
+********************************************************/
+#define CANDADOS_ENVIO 64
+
+static pthread_mutex_t candadosEnvio[CANDADOS_ENVIO];
+
+pthread_mutex_t *candadoEnvio(int socketFD) {
+    return &candadosEnvio[(unsigned)socketFD % CANDADOS_ENVIO];
+}
+
+// Escribe todo el bloque; send puede escribir menos de lo pedido
+int escribirTodo(int socketFD, const char *datos, size_t largo) {
+    while (largo > 0) {
+        ssize_t enviados = send(socketFD, datos, largo, 0);
+        if (enviados <= 0) {
+            return 0;
+        }
+        datos += enviados;
+        largo -= (size_t)enviados;
+    }
+    return 1;
+}
+
+// Envía un bloque completo del JSON
+cJSON_bool enviarBloque(void *contexto, const char *datos, size_t largo) {
+    int socketFD = *(int *)contexto;
+    pthread_mutex_lock(candadoEnvio(socketFD));
+    int enviado = escribirTodo(socketFD, datos, largo);
+    pthread_mutex_unlock(candadoEnvio(socketFD));
+    return enviado;
+}
+
+// Escribe varias partes seguidas con writev; como send, puede quedar algo pendiente
+int escribirPartes(int socketFD, struct iovec *partes, int n) {
+    while (n > 0) {
+        ssize_t enviados = writev(socketFD, partes, n);
+        if (enviados <= 0) {
+            return 0;
+        }
+        while (n > 0 && (size_t)enviados >= partes->iov_len) {
+            enviados -= (ssize_t)partes->iov_len;
+            partes++;
+            n--;
+        }
+        if (n > 0) {
+            partes->iov_base = (char *)partes->iov_base + enviados;
+            partes->iov_len -= (size_t)enviados;
+        }
+    }
+    return 1;
+}
+
+// Envía las partes como un solo mensaje
+int enviarPartes(int socketFD, struct iovec *partes, int n) {
+    pthread_mutex_lock(candadoEnvio(socketFD));
+    int enviado = escribirPartes(socketFD, partes, n);
+    pthread_mutex_unlock(candadoEnvio(socketFD));
+    return enviado;
+}
+
+// Cada hilo imprime en su propio buffer y lo reutiliza entre mensajes;
+// solo crece (una vez, al tamaño exacto) si llega una respuesta más grande
+static _Thread_local cJSON_PrintBuffer bufferSalida;
+
+// DM y BROADCAST reenviados, uno por formato: un BROADCAST se arma a
+// lo sumo una vez por formato sin importar cuántos destinatarios haya
+static _Thread_local cJSON_PrintBuffer bufferReenvio[NUM_FORMATOS];
+
+// Copia de un DM o BROADCAST sin los campos del servidor (ver
+// copiarObjetoPropio); la lectura in situ modifica el buffer de entrada
+static _Thread_local cJSON_PrintBuffer bufferOriginal;
+
+// Lo negociado con el cliente de este hilo en su REGISTRO
+typedef struct {
+    FormatoSalida formato;  // Para sus respuestas y para leer lo que manda
+                            // (en FORMATO_BINARIO llegan marcos en vez de JSON)
+    char nombre[50];        // "" si aún no se registra; DM y BROADCAST solo se
+                            // aceptan si "nombre_emisor" es este nombre
+    int indice;             // Su posición en clientesConectados (-1 si no se registra)
+    long id;                // Su id de usuario, que va en el OK del REGISTRO
+    int version;            // VERSION_PROTOCOLO o menor, si el cliente es anterior
+    unsigned capacidades;   // Capacidad otorgadas
+    size_t marcoMaximo;     // Solicitud más grande que se le acepta
+} Sesion;
+
+static _Thread_local Sesion sesion;
+
+// "id" de la solicitud que se está atendiendo (SIN_ENTERO si no trae);
+// cada respuesta a ella lo lleva. Los DM y BROADCAST reenviados no son
+// respuestas: se les quita el "id" de su emisor (ver campoDelServidor).
+static _Thread_local long idSolicitud = SIN_ENTERO;
+static _Thread_local int solicitudRespondida;
+
+// Con PIPELINE las respuestas se acumulan aquí y se mandan juntas antes
+// del siguiente recv: muchas solicitudes en un recv, una sola escritura
+static _Thread_local cJSON_PrintBuffer bufferPendiente;
+static _Thread_local size_t largoPendiente;
+
+// Dentro de un BATCH las respuestas se juntan aquí, en orden, y salen
+// todas en una sola respuesta al final
+static _Thread_local cJSON *respuestasLote;
+
+void vaciarSalida(int socketFD) {
+    if (largoPendiente > 0) {
+        enviarBloque(&socketFD, bufferPendiente.buffer, largoPendiente);
+        largoPendiente = 0;
+    }
+}
+
+// Dentro de un BATCH guarda la respuesta en el lote y retorna 0; si no, le
+// agrega el "id" de la solicitud y retorna 1: hay que enviarla
+int prepararRespuesta(cJSON *obj) {
+    if (respuestasLote != NULL) {
+        // Se pasan los campos a un objeto nuevo: quien llamó borra el suyo
+        cJSON *respuesta = cJSON_CreateObject();
+        if (respuesta != NULL) {
+            respuesta->child = obj->child;
+            obj->child = NULL;
+            cJSON_AddItemToArray(respuestasLote, respuesta);
+        }
+        return 0;
+    }
+    if (idSolicitud != SIN_ENTERO) {
+        cJSON_AddNumberToObject(obj, "id", (double)idSolicitud);
+    }
+    solicitudRespondida = 1;
+    return 1;
+}
+
+// Respuesta al cliente que atiende este hilo
+void enviarJSON(int socketFD, cJSON *obj) {
+    size_t largo = 0;
+    if (!prepararRespuesta(obj)) {
+        return;
+    }
+
+    char *texto = sesion.formato == FORMATO_BINARIO
+        ? imprimirBinario(obj, &bufferSalida, &largo)
+        : cJSON_PrintReusable(obj, sesion.formato == FORMATO_SANGRIA, &bufferSalida, &largo);
+    if (texto == NULL) {
+        return;
+    }
+    if (!(sesion.capacidades & CAP_PIPELINE)) {
+        enviarBloque(&socketFD, texto, largo);
+        return;
+    }
+
+    Escritor e = { &bufferPendiente, largoPendiente, 0 };
+    escribirBytes(&e, texto, largo);
+    if (e.fallo) {
+        vaciarSalida(socketFD);
+        enviarBloque(&socketFD, texto, largo);
+        return;
+    }
+    largoPendiente = e.largo;
+    if (largoPendiente >= MAX_PENDIENTE) {
+        vaciarSalida(socketFD);
+    }
+}
+
+// Escribe un bloque del JSON; quien imprime ya tiene el candado del socket
+cJSON_bool escribirBloque(void *contexto, const char *datos, size_t largo) {
+    return escribirTodo(*(int *)contexto, datos, largo);
+}
+
+// Para respuestas que pueden ser grandes (LISTA, BATCH): en texto se
+// escriben al socket por bloques mientras se imprimen, sin armarlas
+// enteras en memoria. El candado se toma para todo el mensaje, así nada
+// se mete entre sus bloques. El marco binario lleva el largo adelante,
+// así que ese formato sigue por enviarJSON, igual que un LISTA dentro de
+// un BATCH.
+void enviarJSONPorBloques(int socketFD, cJSON *obj) {
+    if (sesion.formato == FORMATO_BINARIO || respuestasLote != NULL) {
+        enviarJSON(socketFD, obj);
+        return;
+    }
+    prepararRespuesta(obj);
+    vaciarSalida(socketFD);  // Las respuestas acumuladas con PIPELINE van antes
+
+    pthread_mutex_lock(candadoEnvio(socketFD));
+    cJSON_PrintStreamed(obj, sesion.formato == FORMATO_SANGRIA, BLOQUE_ENVIO, escribirBloque, &socketFD);
+    pthread_mutex_unlock(candadoEnvio(socketFD));
+}
+
 void responderOK(int socketFD) {
     cJSON *resp = cJSON_CreateObject();
     cJSON_AddStringToObject(resp, "respuesta", "OK");
-    char *str = cJSON_Print(resp);
-    send(socketFD, str, strlen(str), 0);
-    free(str);
+    enviarJSON(socketFD, resp);
     cJSON_Delete(resp);
 }
 
@@ -55,29 +454,119 @@ void responderError(int socketFD, const char *razon) {
     cJSON *resp = cJSON_CreateObject();
     cJSON_AddStringToObject(resp, "respuesta", "ERROR");
     cJSON_AddStringToObject(resp, "razon", razon);
-    char *str = cJSON_Print(resp);
-    send(socketFD, str, strlen(str), 0);
-    free(str);
+    enviarJSON(socketFD, resp);
     cJSON_Delete(resp);
 }
 
-void enviarJSON(int socketFD, cJSON *obj) {
-    char *str = cJSON_Print(obj);
-    send(socketFD, str, strlen(str), 0);
-    free(str);
+/********************************************************
+* Versión del registro: cada alta o baja de un usuario la
+* sube y queda anotada en un log circular con las últimas
+* MAX_CAMBIOS. Un LISTA con "desde_version" recibe solo
+* las altas y bajas netas desde esa versión; si ya salió
+* del log recibe la lista completa. Arranca en un valor
+* sacado de la hora, así una versión de una ejecución
+* anterior del servidor cae fuera del log.
+********************************************************/
+typedef struct {
+    char nombre[50];
+    int alta;  // 1 = se registró, 0 = se fue
+} CambioRegistro;
+
+static CambioRegistro cambiosRegistro[MAX_CAMBIOS];  // El de la versión v está en v % MAX_CAMBIOS
+static long versionRegistro;
+static long versionInicial;  // Antes de esta no hay cambios anotados
+
+// Se llama con clientesMutex tomado
+void anotarCambio(const char *nombre, int alta) {
+    CambioRegistro *c = &cambiosRegistro[++versionRegistro % MAX_CAMBIOS];
+    strcpy(c->nombre, nombre);
+    c->alta = alta;
 }
 
-int registrarUsuario(const char *nombre, const char *ip, int socketFD) {
-    pthread_mutex_lock(&clientesMutex);
+/********************************************************
+* Índice de nombres: las posiciones de los clientes
+* registrados ordenadas por nombre (strcmp). Se mantiene
+* al registrar y al liberar; MOSTRAR, ESTADO y el chequeo
+* de nombre repetido lo usan con búsqueda binaria, y
+* BUSCAR recorre el rango de un prefijo. Se protege con
+* clientesMutex.
+********************************************************/
+static int indiceNombres[MAX_CLIENTS];
+static int numIndexados;
 
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clientesConectados[i].activo == 1) {
-            if (strcmp(clientesConectados[i].nombre, nombre) == 0) {
-                pthread_mutex_unlock(&clientesMutex);
-                return -1;
-            }
+// Primera posición del índice cuyo nombre no es menor que nombre
+int cotaInferior(const char *nombre) {
+    int bajo = 0;
+    int alto = numIndexados;
+    while (bajo < alto) {
+        int medio = (bajo + alto) / 2;
+        if (strcmp(clientesConectados[indiceNombres[medio]].nombre, nombre) < 0) {
+            bajo = medio + 1;
+        } else {
+            alto = medio;
         }
     }
+    return bajo;
+}
+
+// Posición en clientesConectados del usuario con ese nombre, o -1
+int buscarNombre(const char *nombre) {
+    int k = cotaInferior(nombre);
+    if (k < numIndexados && strcmp(clientesConectados[indiceNombres[k]].nombre, nombre) == 0) {
+        return indiceNombres[k];
+    }
+    return -1;
+}
+
+void indexarNombre(int i) {
+    int k = cotaInferior(clientesConectados[i].nombre);
+    memmove(&indiceNombres[k + 1], &indiceNombres[k], sizeof(int) * (size_t)(numIndexados - k));
+    indiceNombres[k] = i;
+    numIndexados++;
+}
+
+// Se llama mientras clientesConectados[i] todavía tiene su nombre
+void desindexarNombre(int i) {
+    int k = cotaInferior(clientesConectados[i].nombre);
+    memmove(&indiceNombres[k], &indiceNombres[k + 1], sizeof(int) * (size_t)(numIndexados - k - 1));
+    numIndexados--;
+}
+
+/********************************************************
+* Ids de usuario: cada REGISTRO da un id numérico con la
+* posición en clientesConectados en id % MAX_CLIENTS y
+* un contador de registros en el resto. Encontrar a un
+* usuario por id es indexar el arreglo y comparar el id;
+* uno viejo no coincide con quien ocupe después esa
+* posición.
+********************************************************/
+static long registrosHechos;
+
+// Posición en clientesConectados del usuario con ese id, o -1; con clientesMutex tomado
+int buscarId(long id) {
+    if (id < 0) {
+        return -1;
+    }
+    int i = (int)(id % MAX_CLIENTS);
+    if (clientesConectados[i].activo != 1 || clientesConectados[i].id != id) {
+        return -1;
+    }
+    return i;
+}
+
+// Por id si vino (no es SIN_ENTERO), si no por nombre
+int buscarUsuario(const char *nombre, long id) {
+    return id != SIN_ENTERO ? buscarId(id) : buscarNombre(nombre);
+}
+
+// Retorna la posición del cliente en clientesConectados, o -1; deja su id en *id
+int registrarUsuario(const char *nombre, const char *ip, int socketFD, FormatoSalida formato, long *id) {
+    pthread_mutex_lock(&clientesMutex);
+
+    if (buscarNombre(nombre) >= 0) {
+        pthread_mutex_unlock(&clientesMutex);
+        return -1;
+    }
 
     for (int i = 0; i < MAX_CLIENTS; i++) {
         if (clientesConectados[i].activo == 0) {
@@ -87,11 +576,17 @@ int registrarUsuario(const char *nombre, const char *ip, int socketFD) {
             strcpy(clientesConectados[i].status, "ACTIVO");
             clientesConectados[i].ultimaActividad = time(NULL);
             clientesConectados[i].activo = 1;
+            clientesConectados[i].formato = formato;
+            clientesConectados[i].id = ++registrosHechos * MAX_CLIENTS + i;
+            *id = clientesConectados[i].id;
+            indexarNombre(i);
+            anotarCambio(nombre, 1);
+            notificarPresencia(nombre);
 
-            printf("[SERVIDOR] Usuario registrado: %s | IP: %s | FD: %d\n",
-                clientesConectados[i].nombre, clientesConectados[i].ip, socketFD);
+            printf("[SERVIDOR] Usuario registrado: %s | IP: %s | FD: %d | ID: %ld\n",
+                clientesConectados[i].nombre, clientesConectados[i].ip, socketFD, *id);
             pthread_mutex_unlock(&clientesMutex);
-            return 0;
+            return i;
         }
     }
 
@@ -112,125 +607,152 @@ int buscarClientePorFD(int fd) {
     return -1;
 }
 
+// Libera todos los registros de la conexión (un cliente puede registrarse
+// más de una vez); se llama antes de cerrar el socket, que puede reutilizarse
 void liberarCliente(int fd) {
     pthread_mutex_lock(&clientesMutex);
     for (int i = 0; i < MAX_CLIENTS; i++) {
         if (clientesConectados[i].activo == 1 &&
             clientesConectados[i].socketFD == fd) {
             clientesConectados[i].activo = 0;
-            printf("[Servidor] Liberado cliente '%s' (FD:%d)\n",
-                   clientesConectados[i].nombre, fd);
-            break;
+            desindexarNombre(i);
+            dejarCanales(i);
+            dejarObservados(i);
+            anotarCambio(clientesConectados[i].nombre, 0);
+            notificarPresencia(clientesConectados[i].nombre);
+            printf("[Servidor] Liberado cliente '%s' (FD:%d, ID:%ld)\n",
+                   clientesConectados[i].nombre, fd, clientesConectados[i].id);
         }
     }
     pthread_mutex_unlock(&clientesMutex);
 }
 
-void manejarBroadcast(int emisorFD, cJSON *root) {
-    cJSON *nom = cJSON_GetObjectItem(root, "nombre_emisor");
-    cJSON *msg = cJSON_GetObjectItem(root, "mensaje");
-    if (!cJSON_IsString(nom) || !cJSON_IsString(msg)) {
-        responderError(emisorFD, "FORMATO_BROADCAST_INVALIDO");
-        return;
-    }
+// Agrega a resp "altas" y "bajas" con los cambios netos después de la
+// versión desde; se llama con clientesMutex tomado y desde dentro del log.
+// Una sola pasada de la más nueva a la más vieja: la primera vez que se ve
+// un nombre es su último cambio, la última es el primero. Los nombres ya
+// vistos van en una tabla abierta con el doble de lugares que cambios.
+void agregarCambios(cJSON *resp, long desde) {
+    cJSON *altas = cJSON_AddArrayToObject(resp, "altas");
+    cJSON *bajas = cJSON_AddArrayToObject(resp, "bajas");
+    const CambioRegistro *ultimo[2 * MAX_CAMBIOS] = { NULL };
+    const CambioRegistro *primero[2 * MAX_CAMBIOS];
+    int orden[MAX_CAMBIOS];  // Lugares de la tabla, del nombre que cambió al final hacia atrás
+    int nombres = 0;
 
-    cJSON *bcast = cJSON_CreateObject();
-    cJSON_AddStringToObject(bcast, "accion", "BROADCAST");
-    cJSON_AddStringToObject(bcast, "nombre_emisor", nom->valuestring);
-    cJSON_AddStringToObject(bcast, "mensaje", msg->valuestring);
-
-    pthread_mutex_lock(&clientesMutex);
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clientesConectados[i].activo == 1) {
-            enviarJSON(clientesConectados[i].socketFD, bcast);
+    for (long v = versionRegistro; v > desde; v--) {
+        const CambioRegistro *c = &cambiosRegistro[v % MAX_CAMBIOS];
+        unsigned int h = 2166136261u;
+        for (const char *p = c->nombre; *p != '\0'; p++) {
+            h = (h ^ (unsigned char)*p) * 16777619u;
+        }
+        int i = (int)(h % (2 * MAX_CAMBIOS));
+        while (ultimo[i] != NULL && strcmp(ultimo[i]->nombre, c->nombre) != 0) {
+            i = (i + 1) % (2 * MAX_CAMBIOS);
+        }
+        if (ultimo[i] == NULL) {
+            ultimo[i] = c;
+            orden[nombres++] = i;
         }
+        primero[i] = c;
     }
-    pthread_mutex_unlock(&clientesMutex);
 
-    cJSON_Delete(bcast);
+    // Si el primer y el último cambio de un nombre no son iguales (se fue y
+    // volvió, o volvió y se fue) se anulan. Se recorren hacia atrás para
+    // que salgan en el orden de su último cambio, como en el log.
+    while (nombres > 0) {
+        int i = orden[--nombres];
+        if (primero[i]->alta == ultimo[i]->alta) {
+            cJSON_AddItemToArray(ultimo[i]->alta ? altas : bajas, cJSON_CreateString(ultimo[i]->nombre));
+        }
+    }
 }
 
-void manejarDM(int emisorFD, cJSON *root) {
-    cJSON *nomEmisor = cJSON_GetObjectItem(root, "nombre_emisor");
-    cJSON *nomDest = cJSON_GetObjectItem(root, "nombre_destinatario");
-    cJSON *msg = cJSON_GetObjectItem(root, "mensaje");
+void manejarLista(int emisorFD, const MensajeLista *m) {
+    cJSON *resp = cJSON_CreateObject();
+    cJSON_AddStringToObject(resp, "accion", "LISTA");
 
-    if (!cJSON_IsString(nomEmisor) || !cJSON_IsString(nomDest) || !cJSON_IsString(msg)) {
-        responderError(emisorFD, "FORMATO_DM_INVALIDO");
-        return;
+    tomarClientes();
+    cJSON_AddNumberToObject(resp, "version", (double)versionRegistro);
+    long desde = m->desde_version;
+    if (desde != SIN_ENTERO && desde >= versionInicial &&
+        desde <= versionRegistro && versionRegistro - desde <= MAX_CAMBIOS) {
+        cJSON_AddNumberToObject(resp, "desde_version", (double)desde);
+        agregarCambios(resp, desde);
+    } else {
+        cJSON *arrUsuarios = cJSON_AddArrayToObject(resp, "usuarios");
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (clientesConectados[i].activo == 1) {
+                cJSON_AddItemToArray(arrUsuarios, cJSON_CreateString(clientesConectados[i].nombre));
+            }
+        }
     }
+    soltarClientes();
 
-    cJSON *dm = cJSON_CreateObject();
-    cJSON_AddStringToObject(dm, "accion", "DM");
-    cJSON_AddStringToObject(dm, "nombre_emisor", nomEmisor->valuestring);
-    cJSON_AddStringToObject(dm, "nombre_destinatario", nomDest->valuestring);
-    cJSON_AddStringToObject(dm, "mensaje", msg->valuestring);
+    enviarJSONPorBloques(emisorFD, resp);
+    cJSON_Delete(resp);
+}
 
-    pthread_mutex_lock(&clientesMutex);
-    int encontrado = 0;
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clientesConectados[i].activo == 1 &&
-            strcmp(clientesConectados[i].nombre, nomDest->valuestring) == 0) {
-            enviarJSON(clientesConectados[i].socketFD, dm);
-            encontrado = 1;
-            break;
+// Los usuarios cuyo nombre empieza con "prefijo", en orden, opcionalmente
+// solo los de un estado; "mas" dice si quedaron otros fuera del límite
+void manejarBuscar(int emisorFD, const MensajeBuscar *m) {
+    char estado[20];
+    if (m->estado != NULL) {
+        strToUpper(estado, m->estado);
+        if (strcmp(estado, "ACTIVO") != 0 &&
+            strcmp(estado, "OCUPADO") != 0 &&
+            strcmp(estado, "INACTIVO") != 0) {
+            responderError(emisorFD, "ESTADO_INVALIDO");
+            return;
         }
     }
-    pthread_mutex_unlock(&clientesMutex);
-
-    if (!encontrado) {
-        responderError(emisorFD, "DESTINATARIO_NO_ENCONTRADO");
-    } else {
-        responderOK(emisorFD);
-    }
-    cJSON_Delete(dm);
-}
+    long limite = m->limite == SIN_ENTERO ? LIMITE_BUSQUEDA : m->limite;
+    size_t largo = strlen(m->prefijo);
 
-void manejarLista(int emisorFD) {
     cJSON *resp = cJSON_CreateObject();
-    cJSON_AddStringToObject(resp, "accion", "LISTA");
-    cJSON *arrUsuarios = cJSON_CreateArray();
+    cJSON_AddStringToObject(resp, "accion", "BUSCAR");
+    cJSON *arrUsuarios = cJSON_AddArrayToObject(resp, "usuarios");
+    int mas = 0;
 
-    pthread_mutex_lock(&clientesMutex);
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clientesConectados[i].activo == 1) {
-            cJSON_AddItemToArray(arrUsuarios, cJSON_CreateString(clientesConectados[i].nombre));
+    tomarClientes();
+    long n = 0;
+    for (int k = cotaInferior(m->prefijo); k < numIndexados; k++) {
+        const Cliente *c = &clientesConectados[indiceNombres[k]];
+        if (strncmp(c->nombre, m->prefijo, largo) != 0) {
+            break;  // Ya pasó el rango del prefijo
+        }
+        if (m->estado != NULL && strcmp(c->status, estado) != 0) {
+            continue;
+        }
+        if (n == limite) {
+            mas = 1;
+            break;
         }
+        cJSON_AddItemToArray(arrUsuarios, cJSON_CreateString(c->nombre));
+        n++;
     }
-    pthread_mutex_unlock(&clientesMutex);
+    soltarClientes();
 
-    cJSON_AddItemToObject(resp, "usuarios", arrUsuarios);
-    char *strJson = cJSON_Print(resp);
-    send(emisorFD, strJson, strlen(strJson), 0);
-    free(strJson);
+    cJSON_AddBoolToObject(resp, "mas", mas);
+    enviarJSON(emisorFD, resp);
     cJSON_Delete(resp);
 }
 
-void manejarMostrar(int emisorFD, cJSON *root) {
-    cJSON *usuario = cJSON_GetObjectItem(root, "usuario");
-    if (!cJSON_IsString(usuario)) {
-        responderError(emisorFD, "FORMATO_MOSTRAR_INVALIDO");
-        return;
-    }
-
+void manejarMostrar(int emisorFD, const MensajeMostrar *m) {
     cJSON *resp = cJSON_CreateObject();
     cJSON_AddStringToObject(resp, "tipo", "MOSTRAR");
 
-    pthread_mutex_lock(&clientesMutex);
-    int encontrado = 0;
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clientesConectados[i].activo == 1 &&
-            strcmp(clientesConectados[i].nombre, usuario->valuestring) == 0) {
-            cJSON_AddStringToObject(resp, "User", clientesConectados[i].nombre);
-            cJSON_AddStringToObject(resp, "estado", clientesConectados[i].status);
-            cJSON_AddStringToObject(resp, "IP", clientesConectados[i].ip);
-            encontrado = 1;
-            break;
-        }
+    tomarClientes();
+    int i = buscarUsuario(m->usuario, m->id_usuario);
+    if (i >= 0) {
+        cJSON_AddStringToObject(resp, "User", clientesConectados[i].nombre);
+        cJSON_AddStringToObject(resp, "estado", clientesConectados[i].status);
+        cJSON_AddStringToObject(resp, "IP", clientesConectados[i].ip);
+        cJSON_AddNumberToObject(resp, "id_usuario", (double)clientesConectados[i].id);
     }
-    pthread_mutex_unlock(&clientesMutex);
+    soltarClientes();
 
-    if (!encontrado) {
+    if (i < 0) {
         cJSON_AddStringToObject(resp, "respuesta", "ERROR");
         cJSON_AddStringToObject(resp, "razon", "USUARIO_NO_ENCONTRADO");
     }
@@ -238,17 +760,9 @@ void manejarMostrar(int emisorFD, cJSON *root) {
     cJSON_Delete(resp);
 }
 
-void manejarEstado(int emisorFD, cJSON *root) {
-    cJSON *usuario = cJSON_GetObjectItem(root, "usuario");
-    cJSON *estado  = cJSON_GetObjectItem(root, "estado");
-
-    if (!cJSON_IsString(usuario) || !cJSON_IsString(estado)) {
-        responderError(emisorFD, "FORMATO_ESTADO_INVALIDO");
-        return;
-    }
-
+void manejarEstado(int emisorFD, const MensajeEstado *m) {
     char nuevoEstado[20];
-    strToUpper(nuevoEstado, estado->valuestring);
+    strToUpper(nuevoEstado, m->estado);
 
            // Verificar que sea uno de los tres permitidos
        if (strcmp(nuevoEstado, "ACTIVO") != 0 &&
@@ -258,29 +772,23 @@ void manejarEstado(int emisorFD, cJSON *root) {
        return;
        }
 
-    pthread_mutex_lock(&clientesMutex);
-    int encontrado = 0;
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clientesConectados[i].activo == 1 &&
-            strcmp(clientesConectados[i].nombre, usuario->valuestring) == 0) {
-
-            char estadoActual[20];
-            strToUpper(estadoActual, clientesConectados[i].status);
+    tomarClientes();
+    int i = buscarUsuario(m->usuario, m->id_usuario);
+    if (i >= 0) {
+        char estadoActual[20];
+        strToUpper(estadoActual, clientesConectados[i].status);
 
-            if (strcmp(estadoActual, nuevoEstado) == 0) {
-                pthread_mutex_unlock(&clientesMutex);
-                responderError(emisorFD, "ESTADO_YA_SELECCIONADO");
-                return;
-            }
-
-            strcpy(clientesConectados[i].status, nuevoEstado); 
-            encontrado = 1;
-            break;
+        if (strcmp(estadoActual, nuevoEstado) == 0) {
+            soltarClientes();
+            responderError(emisorFD, "ESTADO_YA_SELECCIONADO");
+            return;
         }
+
+        cambiarEstado(i, nuevoEstado);
     }
-    pthread_mutex_unlock(&clientesMutex);
+    soltarClientes();
 
-    if (!encontrado) {
+    if (i < 0) {
         responderError(emisorFD, "USUARIO_NO_ENCONTRADO");
     } else {
         responderOK(emisorFD);
@@ -290,7 +798,10 @@ void manejarEstado(int emisorFD, cJSON *root) {
 /********************************************************
 * Función de verificación de inactividad (modificada)
 ********************************************************/
+void imprimirEstadisticas(void);  // Definida junto al registro de mensajes
+
 void* verificarInactividad(void *arg) {
+   (void)arg;
    while (1) {
        sleep(INTERVALO_VERIFICACION);
        time_t ahora = time(NULL);
@@ -302,108 +813,1281 @@ void* verificarInactividad(void *arg) {
                if (segundosInactivo >= TIEMPO_INACTIVIDAD) {
                    printf("[Servidor] Usuario %s marcado como INACTIVO (%.0f segundos)\n",
                           clientesConectados[i].nombre, segundosInactivo);
-                   strcpy(clientesConectados[i].status, "INACTIVO");  // Solo cambia el estado
+                   cambiarEstado(i, "INACTIVO");  // Solo cambia el estado
                }
            }
        }
        pthread_mutex_unlock(&clientesMutex);
+
+       imprimirEstadisticas();
    }
    return NULL;
 }
 
-void* manejarCliente(void *arg) {
-    int clientFD = *(int*)arg;
-    free(arg);
+/********************************************************
+* Publicación de presencia: duerme hasta que vence la
+* ventana del primer cambio pendiente y manda a cada suscriptor un
+* {"accion":"PRESENCIA","estados":{usuario: estado, ...}}
+* con los que cambiaron, en el formato de ese cliente.
+* Los eventos se arman con clientesMutex tomado, pero se
+* mandan después de soltarlo: un suscriptor lento no
+* frena a los demás hilos.
+********************************************************/
+static cJSON_PrintBuffer bufferPresencia[MAX_CLIENTS];  // Uno por destino; solo los usa el hilo de presencia
 
-    while (1) {
-        char buffer[BUFSIZE];
-        memset(buffer, 0, BUFSIZE);
-        int bytes = recv(clientFD, buffer, BUFSIZE - 1, 0);
-        if (bytes <= 0) {
-            printf("[Hilo] Cliente FD: %d desconectado\n", clientFD);
-            close(clientFD);
-            liberarCliente(clientFD);
-            pthread_exit(NULL);
+// Se llama con clientesMutex tomado; NULL si no se pudo armar
+char *armarPresencia(const Cliente *destino, const int *cambiados, int n, uint64_t bit,
+                     cJSON_PrintBuffer *buffer, size_t *largo) {
+    cJSON *evento = cJSON_CreateObject();
+    cJSON_AddStringToObject(evento, "accion", "PRESENCIA");
+    cJSON *estados = cJSON_AddObjectToObject(evento, "estados");
+    for (int k = 0; k < n; k++) {
+        const Observado *o = &observados[cambiados[k]];
+        if (o->suscriptores & bit) {
+            cJSON_AddStringToObject(estados, o->nombre, o->publicado);
         }
+    }
 
-        // Actualizar actividad y estado
-       pthread_mutex_lock(&clientesMutex);
-       for (int i = 0; i < MAX_CLIENTS; i++) {
-           if (clientesConectados[i].activo == 1 && 
-               clientesConectados[i].socketFD == clientFD) {
-               clientesConectados[i].ultimaActividad = time(NULL);
-               strcpy(clientesConectados[i].status, "ACTIVO");  // Resetear a ACTIVO
-               break;
-           }
-       }
-       pthread_mutex_unlock(&clientesMutex);
-
+    char *texto = destino->formato == FORMATO_BINARIO
+        ? imprimirBinario(evento, buffer, largo)
+        : cJSON_PrintReusable(evento, destino->formato == FORMATO_SANGRIA, buffer, largo);
+    cJSON_Delete(evento);
+    return texto;
+}
 
-        cJSON *root = cJSON_Parse(buffer);
-        if (!root) {
-            responderError(clientFD, "JSON_INVALIDO");
+void* publicarPresencia(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&clientesMutex);
+    while (1) {
+        if (proximaPublicacion == 0) {
+            pthread_cond_wait(&presenciaCond, &clientesMutex);
             continue;
         }
-
-        cJSON *accion = cJSON_GetObjectItem(root, "accion");
-        cJSON *tipo   = cJSON_GetObjectItem(root, "tipo");
-
-        if (accion && cJSON_IsString(accion)) {
-            if (strcmp(accion->valuestring, "BROADCAST") == 0) {
-                manejarBroadcast(clientFD, root);
-            } else if (strcmp(accion->valuestring, "DM") == 0) {
-                manejarDM(clientFD, root);
-            } else if (strcmp(accion->valuestring, "LISTA") == 0) {
-                manejarLista(clientFD);
-            } else {
-                responderError(clientFD, "ACCION_NO_IMPLEMENTADA");
+        long long espera = proximaPublicacion - milisegundos();
+        if (espera > 0) {
+            struct timespec limite;
+            clock_gettime(CLOCK_REALTIME, &limite);
+            limite.tv_sec += espera / 1000;
+            limite.tv_nsec += (espera % 1000) * 1000000;
+            if (limite.tv_nsec >= 1000000000L) {
+                limite.tv_sec++;
+                limite.tv_nsec -= 1000000000L;
             }
+            pthread_cond_timedwait(&presenciaCond, &clientesMutex, &limite);
+            continue;
         }
-        else if (tipo && cJSON_IsString(tipo)) {
-            if (strcmp(tipo->valuestring, "REGISTRO") == 0) {
-                cJSON *usuario = cJSON_GetObjectItem(root, "usuario");
-                cJSON *direccionIP = cJSON_GetObjectItem(root, "direccionIP");
-                if (!cJSON_IsString(usuario) || !cJSON_IsString(direccionIP)) {
-                    responderError(clientFD, "CAMPOS_REGISTRO_INVALIDOS");
-                } else {
-                    if (registrarUsuario(usuario->valuestring, direccionIP->valuestring, clientFD) == 0) {
-                        responderOK(clientFD);
-                    } else {
-                        responderError(clientFD, "USUARIO_O_IP_DUPLICADO");
-                    }
-                }
-            }
-            else if (strcmp(tipo->valuestring, "EXIT") == 0) {
-                responderOK(clientFD);
-                close(clientFD);
-                liberarCliente(clientFD);
-                cJSON_Delete(root);
-                pthread_exit(NULL);
-            }
-            else if (strcmp(tipo->valuestring, "MOSTRAR") == 0) {
-                manejarMostrar(clientFD, root);
-            }
-            else if (strcmp(tipo->valuestring, "ESTADO") == 0) {
-                manejarEstado(clientFD, root);
+
+        int cambiados[MAX_OBSERVADOS];
+        int n = 0;
+        uint64_t destinos = 0;
+        proximaPublicacion = 0;
+        for (int i = 0; i < MAX_OBSERVADOS; i++) {
+            Observado *o = &observados[i];
+            if (o->nombre[0] == '\0' || !o->pendiente) {
+                continue;
             }
-            else {
-                responderError(clientFD, "TIPO_NO_IMPLEMENTADO");
+            o->pendiente = 0;
+            const char *estado = estadoPresencia(o->nombre);
+            if (strcmp(estado, o->publicado) != 0) {  // Si volvió al publicado no hay nada que mandar
+                strcpy(o->publicado, estado);
+                cambiados[n++] = i;
+                destinos |= o->suscriptores;
             }
         }
-        else {
-            responderError(clientFD, "FALTA_TIPO_O_ACCION");
+        // Cada envío va por una copia (dup) del socket: si el cliente se va
+        // antes de que salga, su número puede ser ya el de otra conexión
+        struct {
+            int socketFD, copia;
+            const char *texto;
+            size_t largo;
+        } envios[MAX_CLIENTS];
+        int m = 0;
+        for (; destinos != 0; destinos &= destinos - 1) {
+            int d = __builtin_ctzll(destinos);
+            envios[m].texto = armarPresencia(&clientesConectados[d], cambiados, n, (uint64_t)1 << d,
+                                             &bufferPresencia[d], &envios[m].largo);
+            envios[m].socketFD = clientesConectados[d].socketFD;
+            envios[m].copia = envios[m].texto != NULL ? dup(envios[m].socketFD) : -1;
+            if (envios[m].copia >= 0) {
+                m++;
+            }
         }
 
-        cJSON_Delete(root);
+        pthread_mutex_unlock(&clientesMutex);
+        for (int k = 0; k < m; k++) {
+            pthread_mutex_lock(candadoEnvio(envios[k].socketFD));
+            escribirTodo(envios[k].copia, envios[k].texto, envios[k].largo);
+            pthread_mutex_unlock(candadoEnvio(envios[k].socketFD));
+            close(envios[k].copia);
+        }
+        pthread_mutex_lock(&clientesMutex);
     }
     return NULL;
 }
 
-int main() {
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        clientesConectados[i].activo = 0;
+/********************************************************
+* Manejadores registrados: uno por mensaje del esquema.
+* Reciben el mensaje ya leído (JSON) o decodificado
+* (binario) y cumpliendo el esquema; retornan RECHAZADA
+* si aun así no se puede atender, para que se responda
+* el error de formato.
+********************************************************/
+typedef enum {
+    SOLICITUD_ATENDIDA,
+    SOLICITUD_RECHAZADA,
+    SOLICITUD_SALIR
+} ResultadoSolicitud;
+
+typedef struct {
+    int clientFD;
+    int binaria;            // Llegó como marco binario
+    const char *original;   // Bytes recibidos (el objeto JSON o el mapa del marco), o NULL
+    size_t largoOriginal;
+    const cJSON_Cursor *raiz;  // La solicitud JSON indexada, o NULL si es binaria
+    unsigned char *marco;      // El mapa del marco binario, o NULL si es JSON
+    size_t largoMarco;
+} Solicitud;
+
+/********************************************************
+* Reenvío de DM y BROADCAST con "verificado":true al
+* inicio del objeto. Con REENVIO_DIRECTO, a quien usa la
+* misma codificación que el emisor se le reenvían los
+* bytes tal como llegaron (nada se vuelve a imprimir);
+* para los demás el mensaje se arma en su formato, a lo
+* sumo una vez por formato. Así un cliente JSON y uno
+* binario se hablan sin saber qué usa el otro. Los bytes
+* directos van sin los campos que pone el servidor. Un DM
+* por nombre lleva a cada destinatario solo el suyo en
+* "nombre_destinatario": el cuerpo se arma una vez y el
+* nombre va aparte en cada envío.
+********************************************************/
+static const char encabezadoReenvio[] = "{\"verificado\":true,";
+static const unsigned char parVerificado[] = "\xaa" "verificado" "\xc3";  // fixstr + true
+static const unsigned char claveDestinatario[] = "\xb3" "nombre_destinatario";  // fixstr
+
+typedef struct {
+    const Solicitud *solicitud;
+    const Mensaje *mensaje;
+    char *texto[NUM_FORMATOS];   // Armado para cada formato, cuando hizo falta
+    size_t largo[NUM_FORMATOS];
+    const char *destinatario;    // DM por nombre: el de quien recibe esta copia
+                                 // (NULL en los demás, para todas las copias)
+} Reenvio;
+
+// Reenvía un objeto JSON (sin su '{', que va en el encabezado). Con
+// destinatario, su nombre va en el lugar de HUECO_DESTINOS.
+void reenviarOriginal(int socketFD, const char *original, size_t largo, const char *destinatario) {
+    struct iovec partes[4];
+    int n = 0;
+    const char *hueco = destinatario != NULL ? memchr(original, HUECO_DESTINOS[0], largo) : NULL;
+
+    partes[n].iov_base = (void *)encabezadoReenvio;
+    partes[n++].iov_len = sizeof(encabezadoReenvio) - 1;
+    partes[n].iov_base = (void *)(original + 1);
+    if (hueco != NULL) {
+        const char *nombre = imprimirDestinos(&destinatario, 1, 0, 1);
+        if (nombre == NULL) {
+            return;
+        }
+        partes[n++].iov_len = (size_t)(hueco - original) - 1;
+        partes[n].iov_base = (void *)nombre;
+        partes[n++].iov_len = strlen(nombre);
+        partes[n].iov_base = (void *)(hueco + 1);
+        largo -= (size_t)(hueco - original);
+    }
+    partes[n++].iov_len = largo - 1;
+    enviarPartes(socketFD, partes, n);
+}
+
+// Reenvía el mapa de un marco binario con un par más (dos con
+// destinatario): nuevo largo, nuevo encabezado del mapa y los pares,
+// y después los pares originales
+void reenviarMarco(int socketFD, const char *mapa, size_t largo, const char *destinatario) {
+    Lector l = { (unsigned char *)mapa, (unsigned char *)mapa + largo };
+    size_t pares = 0;
+    if (!leerMapa(&l, &pares)) {
+        return;
+    }
+    size_t encabezadoOriginal = (size_t)((const char *)l.p - mapa);
+
+    // El nombre viene del registro (menos de 50 bytes): str8 a lo sumo
+    char encabezado[LARGO_MARCO + 5 + sizeof(parVerificado) + sizeof(claveDestinatario) + 2 + 50];
+    cJSON_PrintBuffer buffer = { encabezado, sizeof(encabezado) };
+    Escritor e = { &buffer, LARGO_MARCO, 0 };
+    escribirMapa(&e, pares + (destinatario != NULL ? 2 : 1));
+    escribirBytes(&e, parVerificado, sizeof(parVerificado) - 1);
+    if (destinatario != NULL) {
+        escribirBytes(&e, claveDestinatario, sizeof(claveDestinatario) - 1);
+        escribirCadena(&e, destinatario);
+    }
+    escribirLargoMarco((unsigned char *)encabezado, e.largo - LARGO_MARCO + largo - encabezadoOriginal);
+
+    struct iovec partes[2];
+    partes[0].iov_base = encabezado;
+    partes[0].iov_len = e.largo;
+    partes[1].iov_base = (void *)l.p;
+    partes[1].iov_len = largo - encabezadoOriginal;
+    enviarPartes(socketFD, partes, 2);
+}
+
+// Claves que pone el servidor: las que trae el emisor no se reenvían
+int campoDelServidor(const char *clave, size_t largo) {
+    return (largo == 2 && strncasecmp(clave, "id", 2) == 0)
+        || (largo == 10 && strncasecmp(clave, "verificado", 10) == 0);
+}
+
+// Solo se comparó con la sesión el primer "nombre_emisor" (sin importar
+// mayúsculas). Otro igual, o uno con otras mayúsculas, saldría con la marca
+// de verificado y quien lo reciba podría quedarse con ese: retorna 0.
+int emisorUnico(const char *clave, size_t largo, int *vistos) {
+    if (largo != 13 || strncasecmp(clave, "nombre_emisor", 13) != 0) {
+        return 1;
+    }
+    return (*vistos)++ == 0 && memcmp(clave, "nombre_emisor", 13) == 0;
+}
+
+// Con destinos (DM), "nombre_destinatario" no se copia: en JSON queda su
+// clave con HUECO_DESTINOS por valor (una repetida no se copia), en
+// binario se quita el par. Cada destinatario lo recibe con su nombre (ver reenviar).
+int esDestinatario(const char *clave, size_t largo, int destinos) {
+    return destinos && largo == sizeof(claveDestinatario) - 2
+        && memcmp(clave, claveDestinatario + 1, largo) == 0;
+}
+
+// Copia el objeto recibido sin los campos del servidor. Sus miembros se
+// vuelven a unir con ',' y ':' (el resto de los bytes no cambia). Retorna
+// 0 si una clave trae escapes: no se compara y el mensaje va por plantilla;
+// -1 si el emisor no es único (ver emisorUnico) y se rechaza.
+int copiarObjetoPropio(const cJSON_Cursor *raiz, int destinos, Escritor *e) {
+    cJSON_Cursor clave, valor;
+    int primero = 1, emisores = 0, hueco = 0;
+
+    escribirBytes(e, "{", 1);
+    for (int hay = cJSON_CursorGetFirstMember(raiz, &clave, &valor); hay;
+         hay = cJSON_CursorGetNextMember(&clave, &valor)) {
+        size_t largoClave, largoValor;
+        const char *k = cJSON_CursorGetRaw(&clave, &largoClave);
+        const char *v = cJSON_CursorGetRaw(&valor, &largoValor);
+        if (memchr(k, '\\', largoClave) != NULL) {
+            return 0;
+        }
+        if (!emisorUnico(k + 1, largoClave - 2, &emisores)) {
+            return -1;
+        }
+        if (campoDelServidor(k + 1, largoClave - 2)) {
+            continue;
+        }
+        int destinatario = esDestinatario(k + 1, largoClave - 2, destinos);
+        if (destinatario && hueco++) {
+            continue;
+        }
+        if (!primero) {
+            escribirBytes(e, ",", 1);
+        }
+        escribirBytes(e, k, largoClave);
+        escribirBytes(e, ":", 1);
+        if (destinatario) {
+            escribirBytes(e, HUECO_DESTINOS, 1);
+        } else {
+            escribirBytes(e, v, largoValor);
+        }
+        primero = 0;
+    }
+    escribirBytes(e, "}", 1);
+    return !primero;  // Sin miembros no se puede poner el encabezado
+}
+
+// Lo mismo para el mapa de un marco: se cuentan los pares que quedan,
+// se escribe el nuevo encabezado y después esos pares tal como llegaron
+int copiarMapaPropio(const char *mapa, size_t largo, int destinos, Escritor *e) {
+    for (int pasada = 0; pasada < 2; pasada++) {
+        Lector l = { (unsigned char *)mapa, (unsigned char *)mapa + largo };
+        size_t pares = 0, quedan = 0;
+        int emisores = 0;
+        if (!leerMapa(&l, &pares)) {
+            return 0;
+        }
+        for (size_t i = 0; i < pares; i++) {
+            unsigned char *par = l.p, *k;
+            size_t largoClave;
+            if (!leerStr(&l, &k, &largoClave) || !saltarValor(&l, 1)) {
+                return 0;
+            }
+            if (!emisorUnico((const char *)k, largoClave, &emisores)) {
+                return -1;
+            }
+            if (campoDelServidor((const char *)k, largoClave)
+                || esDestinatario((const char *)k, largoClave, destinos)) {
+                continue;
+            }
+            if (pasada == 1) {
+                escribirBytes(e, par, (size_t)(l.p - par));
+            }
+            quedan++;
+        }
+        if (pasada == 0) {
+            escribirMapa(e, quedan);
+        }
+    }
+    return 1;
+}
+
+// Se llama con clientesMutex tomado
+void reenviar(Reenvio *r, const Cliente *destino) {
+    const Solicitud *s = r->solicitud;
+    FormatoSalida f = destino->formato;
+    int binario = f == FORMATO_BINARIO;
+
+    if (s->original != NULL && binario == s->binaria) {
+        if (binario) {
+            reenviarMarco(destino->socketFD, s->original, s->largoOriginal, r->destinatario);
+        } else {
+            reenviarOriginal(destino->socketFD, s->original, s->largoOriginal, r->destinatario);
+        }
+        return;
+    }
+
+    // Con destinatario, el marco se arma sin "verificado" y sin el nombre,
+    // que se agregan en cada envío como a los bytes directos
+    if (r->texto[f] == NULL) {
+        r->texto[f] = binario
+            ? codificarMensaje(r->mensaje, r->destinatario == NULL, &bufferReenvio[f], &r->largo[f])
+            : serializarMensaje(r->mensaje, f == FORMATO_COMPACTO, &bufferReenvio[f], &r->largo[f]);
+    }
+    if (r->texto[f] == NULL) {
+        return;
+    }
+    if (binario && r->destinatario == NULL) {
+        enviarBloque((void *)&destino->socketFD, r->texto[f], r->largo[f]);
+    } else if (binario) {
+        reenviarMarco(destino->socketFD, r->texto[f] + LARGO_MARCO, r->largo[f] - LARGO_MARCO, r->destinatario);
+    } else {
+        reenviarOriginal(destino->socketFD, r->texto[f], r->largo[f], r->destinatario);
+    }
+}
+
+// DM y BROADCAST solo se aceptan si "nombre_emisor" es el de la sesión
+int emisorValido(const char *nombre) {
+    return sesion.nombre[0] != '\0' && strcmp(nombre, sesion.nombre) == 0;
+}
+
+// Lo que pidió el cliente, recortado a lo que soporta este servidor
+void negociar(const MensajeRegistro *r, Sesion *nueva) {
+    unsigned pedidas = 0;
+    for (int i = 0; i < r->num_capacidades; i++) {
+        for (int j = 0; j < NUM_CAPACIDADES; j++) {
+            if (strcmp(r->capacidades[i], nombresCapacidades[j].nombre) == 0) {
+                pedidas |= nombresCapacidades[j].bit;  // Las que no conoce se ignoran
+            }
+        }
+    }
+    // "formato" es anterior a las capacidades y se sigue aceptando
+    if (r->formato != NULL && strcmp(r->formato, "COMPACTO") == 0) {
+        pedidas |= CAP_COMPACTO;
+    } else if (r->formato != NULL && strcmp(r->formato, "BINARIO") == 0) {
+        pedidas |= CAP_BINARIO;
+    }
+
+    nueva->capacidades = pedidas & CAPACIDADES_SERVIDOR;
+    nueva->version = r->version == SIN_ENTERO ? 1
+                   : r->version < VERSION_PROTOCOLO ? (int)r->version : VERSION_PROTOCOLO;
+    nueva->marcoMaximo = r->marco_maximo != SIN_ENTERO && (size_t)r->marco_maximo < MAX_SOLICITUD
+                       ? (size_t)r->marco_maximo : MAX_SOLICITUD;
+    nueva->formato = (nueva->capacidades & CAP_BINARIO) ? FORMATO_BINARIO
+                   : (nueva->capacidades & CAP_COMPACTO) ? FORMATO_COMPACTO
+                   : FORMATO_SANGRIA;
+}
+
+// El OK de un cliente que negoció lleva lo que se le otorgó;
+// a uno anterior (sin "version" ni "capacidades") se le responde como siempre
+void responderRegistro(int socketFD, const MensajeRegistro *r) {
+    if (r->version == SIN_ENTERO && r->num_capacidades == 0 && r->marco_maximo == SIN_ENTERO) {
+        responderOK(socketFD);
+        return;
+    }
+
+    cJSON *resp = cJSON_CreateObject();
+    cJSON_AddStringToObject(resp, "respuesta", "OK");
+    cJSON_AddNumberToObject(resp, "version", sesion.version);
+    cJSON *capacidades = cJSON_AddArrayToObject(resp, "capacidades");
+    for (int i = 0; i < NUM_CAPACIDADES; i++) {
+        if (sesion.capacidades & nombresCapacidades[i].bit) {
+            cJSON_AddItemToArray(capacidades, cJSON_CreateStringReference(nombresCapacidades[i].nombre));
+        }
+    }
+    cJSON_AddNumberToObject(resp, "marco_maximo", (double)sesion.marcoMaximo);
+    cJSON_AddNumberToObject(resp, "id_usuario", (double)sesion.id);
+    enviarJSON(socketFD, resp);
+    cJSON_Delete(resp);
+}
+
+ResultadoSolicitud atenderRegistro(const Solicitud *s, const Mensaje *m) {
+    const MensajeRegistro *r = &m->Registro;
+    Sesion nueva = sesion;
+    negociar(r, &nueva);
+
+    // Al pasar a binario el OK todavía va en JSON y lo que sigue en marcos.
+    // Se registra como compacto y se cambia con el OK bajo el mutex, para
+    // que ningún reenvío de otro hilo quede en el formato equivocado.
+    int pasaABinario = nueva.formato == FORMATO_BINARIO && sesion.formato != FORMATO_BINARIO;
+    nueva.indice = registrarUsuario(r->usuario, r->direccionIP, s->clientFD,
+                                    pasaABinario ? FORMATO_COMPACTO : nueva.formato, &nueva.id);
+    if (nueva.indice < 0) {
+        responderError(s->clientFD, "USUARIO_O_IP_DUPLICADO");
+        return SOLICITUD_ATENDIDA;
+    }
+    strcpy(nueva.nombre, r->usuario);
+    sesion = nueva;
+    if (!pasaABinario) {
+        responderRegistro(s->clientFD, r);
+        return SOLICITUD_ATENDIDA;
+    }
+
+    sesion.formato = FORMATO_COMPACTO;
+    pthread_mutex_lock(&clientesMutex);
+    responderRegistro(s->clientFD, r);
+    vaciarSalida(s->clientFD);  // Si pidió PIPELINE, el OK no puede esperar
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clientesConectados[i].activo == 1 && clientesConectados[i].socketFD == s->clientFD) {
+            clientesConectados[i].formato = FORMATO_BINARIO;
+        }
+    }
+    sesion.formato = FORMATO_BINARIO;
+    pthread_mutex_unlock(&clientesMutex);
+    return SOLICITUD_ATENDIDA;
+}
+
+ResultadoSolicitud atenderBroadcast(const Solicitud *s, const Mensaje *m) {
+    if (!emisorValido(m->Broadcast.nombre_emisor)) {
+        responderError(s->clientFD, "EMISOR_NO_COINCIDE");
+        return SOLICITUD_ATENDIDA;
+    }
+    vaciarSalida(s->clientFD);  // Su propia copia no puede adelantarse a respuestas anteriores
+
+    Reenvio r = { s, m, { NULL }, { 0 }, NULL };
+    tomarClientes();
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clientesConectados[i].activo == 1) {
+            reenviar(&r, &clientesConectados[i]);
+        }
+    }
+    soltarClientes();
+    return SOLICITUD_ATENDIDA;
+}
+
+// DM con "id_destinatario": el destinatario se encuentra indexando el
+// registro. Lo que se rearma con plantillas lleva su nombre, así quien lo
+// recibe no necesita conocer los ids.
+ResultadoSolicitud atenderDMPorId(const Solicitud *s, const Mensaje *m) {
+    Mensaje copia = *m;
+    Reenvio r = { s, &copia, { NULL }, { 0 }, NULL };
+
+    tomarClientes();
+    int i = buscarId(m->DM.id_destinatario);
+    if (i >= 0) {
+        copia.DM.nombre_destinatario[0] = clientesConectados[i].nombre;
+        copia.DM.num_nombre_destinatario = 1;
+        reenviar(&r, &clientesConectados[i]);
+    }
+    soltarClientes();
+
+    if (i < 0) {
+        responderError(s->clientFD, "DESTINATARIO_NO_ENCONTRADO");
+    } else {
+        responderOK(s->clientFD);
+    }
+    return SOLICITUD_ATENDIDA;
+}
+
+// nombre_destinatario puede ser un arreglo (DM a varios): todos se buscan
+// en una sola pasada por el registro y cada uno recibe el mismo mensaje,
+// armado a lo sumo una vez por formato, con solo su nombre como
+// nombre_destinatario (la lista no se reenvía). Con arreglo se responde un solo OK
+// con "desconocidos" (los nombres que no están conectados). En vez de
+// nombre_destinatario puede venir "id_destinatario".
+ResultadoSolicitud atenderDM(const Solicitud *s, const Mensaje *m) {
+    const MensajeDM *dm = &m->DM;
+    if ((dm->num_nombre_destinatario > 0) == (dm->id_destinatario != SIN_ENTERO)) {
+        return SOLICITUD_RECHAZADA;  // Uno de los dos, no ambos
+    }
+    if (!emisorValido(dm->nombre_emisor)) {
+        responderError(s->clientFD, "EMISOR_NO_COINCIDE");
+        return SOLICITUD_ATENDIDA;
+    }
+    vaciarSalida(s->clientFD);  // Puede ser un DM a sí mismo
+    if (dm->id_destinatario != SIN_ENTERO) {
+        return atenderDMPorId(s, m);
+    }
+
+    Mensaje copia = *m;
+    copia.DM.num_nombre_destinatario = 0;  // Deja el hueco (ver imprimirDestinos)
+    copia.DM.lista_nombre_destinatario = 1;
+    Reenvio r = { s, &copia, { NULL }, { 0 }, NULL };
+    char encontrado[MAX_DESTINOS] = { 0 };
+    int entregados = 0;
+    tomarClientes();
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clientesConectados[i].activo != 1) {
+            continue;
+        }
+        int destinatario = 0;
+        for (int j = 0; j < dm->num_nombre_destinatario; j++) {
+            if (strcmp(clientesConectados[i].nombre, dm->nombre_destinatario[j]) == 0) {
+                encontrado[j] = 1;  // Un nombre repetido en la lista recibe una sola copia
+                destinatario = 1;
+            }
+        }
+        if (destinatario) {
+            r.destinatario = clientesConectados[i].nombre;
+            reenviar(&r, &clientesConectados[i]);
+            entregados++;
+        }
+    }
+    soltarClientes();
+
+    if (entregados == 0 && !dm->lista_nombre_destinatario) {
+        responderError(s->clientFD, "DESTINATARIO_NO_ENCONTRADO");
+        return SOLICITUD_ATENDIDA;
+    }
+    if (!dm->lista_nombre_destinatario) {
+        responderOK(s->clientFD);
+        return SOLICITUD_ATENDIDA;
+    }
+
+    cJSON *resp = cJSON_CreateObject();
+    cJSON_AddStringToObject(resp, "respuesta", entregados > 0 ? "OK" : "ERROR");
+    if (entregados == 0) {
+        cJSON_AddStringToObject(resp, "razon", "DESTINATARIO_NO_ENCONTRADO");
+    }
+    cJSON *desconocidos = cJSON_AddArrayToObject(resp, "desconocidos");
+    for (int j = 0; j < dm->num_nombre_destinatario; j++) {
+        if (!encontrado[j]) {
+            cJSON_AddItemToArray(desconocidos, cJSON_CreateStringReference(dm->nombre_destinatario[j]));
+        }
+    }
+    enviarJSON(s->clientFD, resp);
+    cJSON_Delete(resp);
+    return SOLICITUD_ATENDIDA;
+}
+
+ResultadoSolicitud atenderJoin(const Solicitud *s, const Mensaje *m) {
+    if (sesion.indice < 0) {
+        responderError(s->clientFD, "USUARIO_NO_REGISTRADO");
+        return SOLICITUD_ATENDIDA;
+    }
+    uint64_t bit = (uint64_t)1 << sesion.indice;
+    const char *error = NULL;
+
+    tomarClientes();
+    Canal *c = buscarCanal(m->Join.canal, 1);
+    if (c == NULL) {
+        error = "DEMASIADOS_CANALES";
+    } else if (c->miembros & bit) {
+        error = "YA_EN_CANAL";
+    } else {
+        c->miembros |= bit;
+    }
+    soltarClientes();
+
+    if (error != NULL) {
+        responderError(s->clientFD, error);
+    } else {
+        responderOK(s->clientFD);
+    }
+    return SOLICITUD_ATENDIDA;
+}
+
+ResultadoSolicitud atenderLeave(const Solicitud *s, const Mensaje *m) {
+    uint64_t bit = sesion.indice < 0 ? 0 : (uint64_t)1 << sesion.indice;
+    int estaba = 0;
+
+    tomarClientes();
+    Canal *c = buscarCanal(m->Leave.canal, 0);
+    if (c != NULL && (c->miembros & bit)) {
+        c->miembros &= ~bit;
+        if (c->miembros == 0) {
+            c->nombre[0] = '\0';
+        }
+        estaba = 1;
+    }
+    soltarClientes();
+
+    if (!estaba) {
+        responderError(s->clientFD, "NO_EN_CANAL");
+    } else {
+        responderOK(s->clientFD);
+    }
+    return SOLICITUD_ATENDIDA;
+}
+
+// Como un BROADCAST, pero solo a los miembros del canal (el emisor debe serlo)
+ResultadoSolicitud atenderChannelMsg(const Solicitud *s, const Mensaje *m) {
+    if (!emisorValido(m->ChannelMsg.nombre_emisor)) {
+        responderError(s->clientFD, "EMISOR_NO_COINCIDE");
+        return SOLICITUD_ATENDIDA;
+    }
+    vaciarSalida(s->clientFD);  // Su propia copia no puede adelantarse a respuestas anteriores
+
+    Reenvio r = { s, m, { NULL }, { 0 }, NULL };
+    int miembro = 0;
+    tomarClientes();
+    Canal *c = buscarCanal(m->ChannelMsg.canal, 0);
+    if (c != NULL && (c->miembros & ((uint64_t)1 << sesion.indice))) {
+        miembro = 1;
+        for (uint64_t pendientes = c->miembros; pendientes != 0; pendientes &= pendientes - 1) {
+            reenviar(&r, &clientesConectados[__builtin_ctzll(pendientes)]);
+        }
+    }
+    soltarClientes();
+
+    if (!miembro) {
+        responderError(s->clientFD, "NO_EN_CANAL");
+    }
+    return SOLICITUD_ATENDIDA;
+}
+
+// Reemplaza la lista de usuarios que observa el cliente (vacía: ninguno) y
+// responde el estado actual de cada uno, con la misma forma que los avisos
+ResultadoSolicitud atenderSuscribir(const Solicitud *s, const Mensaje *m) {
+    const MensajeSuscribir *sus = &m->Suscribir;
+    if (sesion.indice < 0) {
+        responderError(s->clientFD, "USUARIO_NO_REGISTRADO");
+        return SOLICITUD_ATENDIDA;
+    }
+    uint64_t bit = (uint64_t)1 << sesion.indice;
+    int completa = 1;
+
+    cJSON *resp = cJSON_CreateObject();
+    cJSON_AddStringToObject(resp, "accion", "PRESENCIA");
+    cJSON *estados = cJSON_AddObjectToObject(resp, "estados");
+
+    tomarClientes();
+    dejarObservados(sesion.indice);
+    for (int i = 0; i < sus->num_usuarios; i++) {
+        Observado *o = buscarObservado(sus->usuarios[i], 1);
+        if (o == NULL) {
+            completa = 0;
+            continue;
+        }
+        o->suscriptores |= bit;
+        if (cJSON_GetObjectItemCaseSensitive(estados, o->nombre) == NULL) {
+            cJSON_AddStringToObject(estados, o->nombre, estadoPresencia(o->nombre));
+        }
+    }
+    soltarClientes();
+
+    if (!completa) {
+        responderError(s->clientFD, "DEMASIADOS_OBSERVADOS");  // Quedan los que cupieron
+    } else {
+        enviarJSON(s->clientFD, resp);
+    }
+    cJSON_Delete(resp);
+    return SOLICITUD_ATENDIDA;
+}
+
+ResultadoSolicitud atenderLista(const Solicitud *s, const Mensaje *m) {
+    manejarLista(s->clientFD, &m->Lista);
+    return SOLICITUD_ATENDIDA;
+}
+
+ResultadoSolicitud atenderBuscar(const Solicitud *s, const Mensaje *m) {
+    manejarBuscar(s->clientFD, &m->Buscar);
+    return SOLICITUD_ATENDIDA;
+}
+
+ResultadoSolicitud atenderMostrar(const Solicitud *s, const Mensaje *m) {
+    if ((m->Mostrar.usuario != NULL) == (m->Mostrar.id_usuario != SIN_ENTERO)) {
+        return SOLICITUD_RECHAZADA;  // "usuario" o "id_usuario", no ambos
+    }
+    manejarMostrar(s->clientFD, &m->Mostrar);
+    return SOLICITUD_ATENDIDA;
+}
+
+ResultadoSolicitud atenderEstado(const Solicitud *s, const Mensaje *m) {
+    if ((m->Estado.usuario != NULL) == (m->Estado.id_usuario != SIN_ENTERO)) {
+        return SOLICITUD_RECHAZADA;  // "usuario" o "id_usuario", no ambos
+    }
+    manejarEstado(s->clientFD, &m->Estado);
+    return SOLICITUD_ATENDIDA;
+}
+
+ResultadoSolicitud atenderExit(const Solicitud *s, const Mensaje *m) {
+    (void)m;
+    responderOK(s->clientFD);
+    return SOLICITUD_SALIR;
+}
+
+ResultadoSolicitud atenderLote(const Solicitud *s, const Mensaje *m);
+
+typedef struct {
+    TipoMensaje tipo;
+    ResultadoSolicitud (*manejador)(const Solicitud *s, const Mensaje *m);
+    int conservaOriginal;       // Se reenvía con los bytes recibidos (ver reenviar)
+    int enLote;                 // Puede ir dentro de un BATCH
+    atomic_ulong recibidas;     // Solicitudes que llegaron con este nombre
+    atomic_ulong rechazadas;    // ...de ellas, las que no cumplían el esquema
+    atomic_ulong nanosegundos;  // Tiempo total dentro del manejador
+} EntradaRegistro;
+
+// Para agregar un mensaje: su entrada en protocolo.def y una línea aquí
+static EntradaRegistro registro[] = {
+    { .tipo = MSJ_Registro,  .manejador = atenderRegistro },
+    { .tipo = MSJ_Broadcast, .manejador = atenderBroadcast, .conservaOriginal = REENVIO_DIRECTO, .enLote = 1 },
+    { .tipo = MSJ_DM,        .manejador = atenderDM,        .conservaOriginal = REENVIO_DIRECTO, .enLote = 1 },
+    { .tipo = MSJ_Lista,     .manejador = atenderLista,     .enLote = 1 },
+    { .tipo = MSJ_Mostrar,   .manejador = atenderMostrar,   .enLote = 1 },
+    { .tipo = MSJ_Estado,    .manejador = atenderEstado,    .enLote = 1 },
+    { .tipo = MSJ_Exit,      .manejador = atenderExit },
+    { .tipo = MSJ_Lote,      .manejador = atenderLote },
+    { .tipo = MSJ_Join,      .manejador = atenderJoin,      .enLote = 1 },
+    { .tipo = MSJ_Leave,     .manejador = atenderLeave,     .enLote = 1 },
+    { .tipo = MSJ_ChannelMsg, .manejador = atenderChannelMsg, .conservaOriginal = REENVIO_DIRECTO, .enLote = 1 },
+    { .tipo = MSJ_Suscribir, .manejador = atenderSuscribir, .enLote = 1 },
+    { .tipo = MSJ_Buscar,    .manejador = atenderBuscar,    .enLote = 1 },
+};
+#define NUM_REGISTRO (int)(sizeof(registro) / sizeof(registro[0]))
+
+/********************************************************
+* Tabla de despacho con hash perfecto: el nombre (con la
+* inicial de su clave, 'a' o 't') se mezcla con FNV-1a y
+* una semilla elegida al arrancar para que ningún par de
+* entradas del registro choque. Buscar es un hash, una
+* posición de la tabla y una comparación.
+********************************************************/
+#define TAM_TABLA_DESPACHO 64  // Potencia de 2, holgada para el registro
+
+static EntradaRegistro *tablaDespacho[TAM_TABLA_DESPACHO];
+static unsigned int semillaDespacho;
+
+unsigned int hashDespacho(unsigned int semilla, char clave, const char *nombre, size_t largo) {
+    unsigned int h = 2166136261u ^ semilla;
+    h = (h ^ (unsigned char)clave) * 16777619u;
+    for (size_t i = 0; i < largo; i++) {
+        h = (h ^ (unsigned char)nombre[i]) * 16777619u;
+    }
+    return h & (TAM_TABLA_DESPACHO - 1);
+}
+
+// Busca la semilla y llena la tabla; 0 si el registro no es válido
+int crearTablaDespacho(void) {
+    for (unsigned int semilla = 0; semilla < 100000; semilla++) {
+        int perfecta = 1;
+        memset(tablaDespacho, 0, sizeof(tablaDespacho));
+        for (int i = 0; i < NUM_REGISTRO && perfecta; i++) {
+            const DescripcionMensaje *d = &descripciones[registro[i].tipo];
+            unsigned int h = hashDespacho(semilla, d->clave[0], d->nombre, strlen(d->nombre));
+            if (tablaDespacho[h] != NULL) {
+                perfecta = 0;
+            } else {
+                tablaDespacho[h] = &registro[i];
+            }
+        }
+        if (perfecta) {
+            semillaDespacho = semilla;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Entrada de la clave ('a' de "accion" o 't' de "tipo") con ese nombre
+EntradaRegistro *buscarEntrada(char clave, const char *nombre, size_t largo) {
+    EntradaRegistro *e = tablaDespacho[hashDespacho(semillaDespacho, clave, nombre, largo)];
+    if (e != NULL && descripciones[e->tipo].clave[0] == clave &&
+        strlen(descripciones[e->tipo].nombre) == largo &&
+        memcmp(descripciones[e->tipo].nombre, nombre, largo) == 0) {
+        return e;
+    }
+    return NULL;
+}
+
+// Igual, con el nombre en un string JSON (el cursor)
+EntradaRegistro *buscarEntradaJSON(char clave, const cJSON_Cursor *valor) {
+    size_t largo = 0;
+    const char *crudo = cJSON_CursorGetRaw(valor, &largo);
+
+    if (memchr(crudo + 1, '\\', largo - 2) == NULL) {
+        return buscarEntrada(clave, crudo + 1, largo - 2);  // Sin las comillas
+    }
+
+    // Con escapes (raro) el hash de los bytes crudos no sirve: se compara uno por uno
+    for (int i = 0; i < NUM_REGISTRO; i++) {
+        const DescripcionMensaje *d = &descripciones[registro[i].tipo];
+        if (d->clave[0] == clave && cJSON_CursorStringEquals(valor, d->nombre)) {
+            return &registro[i];
+        }
+    }
+    return NULL;
+}
+
+// Registra en el log las entradas con actividad, si hubo algo nuevo
+void imprimirEstadisticas(void) {
+    static unsigned long ultimoTotal = 0;
+    unsigned long total = 0;
+
+    for (int i = 0; i < NUM_REGISTRO; i++) {
+        total += atomic_load(&registro[i].recibidas);
+    }
+    if (total == ultimoTotal) {
+        return;
+    }
+    ultimoTotal = total;
+
+    printf("[Servidor] Estadísticas por mensaje:\n");
+    for (int i = 0; i < NUM_REGISTRO; i++) {
+        unsigned long recibidas = atomic_load(&registro[i].recibidas);
+        if (recibidas == 0) {
+            continue;
+        }
+        printf("  %-10s recibidas: %lu | rechazadas: %lu | promedio: %.1f us\n",
+               descripciones[registro[i].tipo].nombre, recibidas,
+               atomic_load(&registro[i].rechazadas),
+               atomic_load(&registro[i].nanosegundos) / 1000.0 / recibidas);
+    }
+}
+
+/********************************************************
+* Lee el mensaje según el esquema de su entrada y llama
+* al manejador; común a JSON (raiz) y binario (marco).
+* Retorna 1 si el cliente pidió salir.
+********************************************************/
+int atenderEntrada(EntradaRegistro *entrada, Solicitud *s, const cJSON_Cursor *raiz,
+                   unsigned char *marco, size_t largoMarco) {
+    const DescripcionMensaje *d = &descripciones[entrada->tipo];
+    Mensaje m;
+    struct timespec inicio, fin;
+
+    if (respuestasLote != NULL && !entrada->enLote) {
+        responderError(s->clientFD, "NO_PERMITIDO_EN_BATCH");
+        return 0;
+    }
+    atomic_fetch_add(&entrada->recibidas, 1);
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+
+    // La copia se hace antes de leer, que termina los strings en el buffer
+    int copiado = 0;
+    if (entrada->conservaOriginal) {
+        Escritor e = { &bufferOriginal, 0, 0 };
+        int destinos = entrada->tipo == MSJ_DM;
+        copiado = s->binaria ? copiarMapaPropio(s->original, s->largoOriginal, destinos, &e)
+                             : copiarObjetoPropio(raiz, destinos, &e);
+        s->original = copiado > 0 && !e.fallo ? (const char *)bufferOriginal.buffer : NULL;
+        s->largoOriginal = e.largo;
+    } else {
+        s->original = NULL;
+    }
+
+    // Un emisor repetido se rechaza con el error de formato, sin atenderlo
+    int leido = copiado >= 0 && (s->binaria ? decodificarMensaje(entrada->tipo, marco, largoMarco, &m)
+                                            : leerMensaje(entrada->tipo, raiz, &m));
+    ResultadoSolicitud resultado = leido ? entrada->manejador(s, &m) : SOLICITUD_RECHAZADA;
+
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    atomic_fetch_add(&entrada->nanosegundos,
+                     (unsigned long)((fin.tv_sec - inicio.tv_sec) * 1000000000L + (fin.tv_nsec - inicio.tv_nsec)));
+
+    if (resultado == SOLICITUD_RECHAZADA) {
+        // Un mensaje sin campos solo se rechaza si el marco está mal formado
+        atomic_fetch_add(&entrada->rechazadas, 1);
+        responderError(s->clientFD, d->errorFormato != NULL ? d->errorFormato : "BINARIO_INVALIDO");
+    }
+    return resultado == SOLICITUD_SALIR;
+}
+
+/********************************************************
+* Busca la entrada de una solicitud JSON ya indexada por
+* "accion" o, si no tiene, por "tipo", y la atiende.
+********************************************************/
+int despacharSolicitud(int clientFD, const cJSON_Cursor *raiz) {
+    cJSON_Cursor valor;
+    EntradaRegistro *entrada = NULL;
+
+    if (cJSON_CursorGetField(raiz, "accion", &valor) && cJSON_CursorType(&valor) == cJSON_String) {
+        entrada = buscarEntradaJSON('a', &valor);
+        if (entrada == NULL) {
+            responderError(clientFD, "ACCION_NO_IMPLEMENTADA");
+            return 0;
+        }
+    } else if (cJSON_CursorGetField(raiz, "tipo", &valor) && cJSON_CursorType(&valor) == cJSON_String) {
+        entrada = buscarEntradaJSON('t', &valor);
+        if (entrada == NULL) {
+            responderError(clientFD, "TIPO_NO_IMPLEMENTADO");
+            return 0;
+        }
+    } else {
+        responderError(clientFD, "FALTA_TIPO_O_ACCION");
+        return 0;
+    }
+
+    Solicitud s = { clientFD, 0, NULL, 0, raiz, NULL, 0 };
+    s.original = cJSON_CursorGetRaw(raiz, &s.largoOriginal);
+    return atenderEntrada(entrada, &s, raiz, NULL, 0);
+}
+
+// Lo mismo para un marco binario (sin los 4 bytes del largo)
+int despacharMarco(int clientFD, unsigned char *marco, size_t largo) {
+    const unsigned char *nombre = NULL;
+    size_t largoNombre = 0;
+    EntradaRegistro *entrada = NULL;
+
+    int accion = buscarClaveBinaria(marco, largo, "accion", &nombre, &largoNombre);
+    if (accion < 0) {
+        responderError(clientFD, "BINARIO_INVALIDO");
+        return 0;
+    }
+    if (accion == 1) {
+        entrada = buscarEntrada('a', (const char *)nombre, largoNombre);
+        if (entrada == NULL) {
+            responderError(clientFD, "ACCION_NO_IMPLEMENTADA");
+            return 0;
+        }
+    } else if (buscarClaveBinaria(marco, largo, "tipo", &nombre, &largoNombre) == 1) {
+        entrada = buscarEntrada('t', (const char *)nombre, largoNombre);
+        if (entrada == NULL) {
+            responderError(clientFD, "TIPO_NO_IMPLEMENTADO");
+            return 0;
+        }
+    } else {
+        responderError(clientFD, "FALTA_TIPO_O_ACCION");
+        return 0;
+    }
+
+    Solicitud s = { clientFD, 1, (const char *)marco, largo, NULL, marco, largo };
+    return atenderEntrada(entrada, &s, NULL, marco, largo);
+}
+
+/********************************************************
+* BATCH: "solicitudes" es un arreglo de solicitudes
+* comunes (DM, BROADCAST, ESTADO, LISTA, MOSTRAR y las
+* de canales) que se atienden en orden con clientesMutex
+* tomado una sola vez. Se responde un solo
+* {"accion":"BATCH","respuestas":[...]} con la respuesta
+* de cada una en su posición (un OK si no tenía, como un
+* BROADCAST).
+********************************************************/
+// Respuesta más reciente del lote (la última del arreglo)
+cJSON *ultimaRespuesta(const cJSON *respuestas) {
+    return respuestas->child != NULL ? respuestas->child->prev : NULL;
+}
+
+ResultadoSolicitud atenderLote(const Solicitud *s, const Mensaje *m) {
+    (void)m;
+    cJSON_Cursor arreglo, item;
+    Lector l;
+    size_t n = 0;
+
+    if (s->binaria) {
+        if (buscarValorBinario(s->marco, s->largoMarco, "solicitudes", &l) != 1 || !leerArreglo(&l, &n)) {
+            return SOLICITUD_RECHAZADA;
+        }
+    } else if (!cJSON_CursorGetField(s->raiz, "solicitudes", &arreglo) ||
+               cJSON_CursorType(&arreglo) != cJSON_Array) {
+        return SOLICITUD_RECHAZADA;
+    }
+
+    cJSON *resp = cJSON_CreateObject();
+    cJSON_AddStringToObject(resp, "accion", "BATCH");
+    cJSON *respuestas = cJSON_AddArrayToObject(resp, "respuestas");
+    if (respuestas == NULL) {
+        cJSON_Delete(resp);
+        responderError(s->clientFD, "SIN_MEMORIA");
+        return SOLICITUD_ATENDIDA;
+    }
+
+    vaciarSalida(s->clientFD);
+    long id = idSolicitud;
+    idSolicitud = SIN_ENTERO;  // El "id" va solo en la respuesta del lote
+    respuestasLote = respuestas;
+    pthread_mutex_lock(&clientesMutex);
+    mutexDelLote = 1;
+
+    if (s->binaria) {
+        for (size_t i = 0; i < n; i++) {
+            unsigned char *inicio = l.p;
+            if (!saltarValor(&l, 2)) {
+                responderError(s->clientFD, "BINARIO_INVALIDO");
+                break;  // No se sabe dónde empieza la siguiente
+            }
+            cJSON *anterior = ultimaRespuesta(respuestas);
+            despacharMarco(s->clientFD, inicio, (size_t)(l.p - inicio));
+            if (ultimaRespuesta(respuestas) == anterior) {
+                responderOK(s->clientFD);
+            }
+        }
+    } else if (cJSON_CursorGetFirstItem(&arreglo, &item)) {
+        do {
+            cJSON *anterior = ultimaRespuesta(respuestas);
+            despacharSolicitud(s->clientFD, &item);
+            if (ultimaRespuesta(respuestas) == anterior) {
+                responderOK(s->clientFD);
+            }
+        } while (cJSON_CursorGetNextItem(&item));
+    }
+
+    mutexDelLote = 0;
+    pthread_mutex_unlock(&clientesMutex);
+    respuestasLote = NULL;
+    idSolicitud = id;
+
+    enviarJSONPorBloques(s->clientFD, resp);
+    cJSON_Delete(resp);
+    return SOLICITUD_ATENDIDA;
+}
+
+/********************************************************
+* Solicitudes con "id": es un entero que se devuelve en
+* cada respuesta, para que el cliente pueda tener varias
+* en camino (se atienden en orden). Con "id" toda
+* solicitud tiene respuesta: un BROADCAST recibe un OK.
+********************************************************/
+// Valida el "id" leído (encontrado: la clave estaba; esNumero: y era
+// un número); 0 si no es un entero válido, ya respondido con un error
+int leerId(int clientFD, int encontrado, int esNumero, double numero) {
+    idSolicitud = SIN_ENTERO;
+    solicitudRespondida = 0;
+    if (encontrado && !(esNumero && enteroValido(numero, 0, ID_MAXIMO, &idSolicitud))) {
+        responderError(clientFD, "ID_INVALIDO");
+        return 0;
+    }
+    return 1;
+}
+
+void terminarSolicitud(int clientFD) {
+    if (idSolicitud != SIN_ENTERO && !solicitudRespondida) {
+        responderOK(clientFD);
+    }
+    idSolicitud = SIN_ENTERO;
+}
+
+// Retornan 1 si el cliente pidió salir
+int procesarSolicitud(int clientFD, const cJSON_Cursor *raiz) {
+    cJSON_Cursor valor;
+    double numero = 0;
+    int encontrado = cJSON_CursorGetField(raiz, "id", &valor);
+    int esNumero = encontrado && cJSON_CursorGetNumber(&valor, &numero);
+    int salir = 0;
+
+    if (leerId(clientFD, encontrado, esNumero, numero)) {
+        salir = despacharSolicitud(clientFD, raiz);
+    }
+    terminarSolicitud(clientFD);
+    return salir;
+}
+
+int procesarMarco(int clientFD, unsigned char *marco, size_t largo) {
+    Lector valor;
+    double numero = 0;
+    int encontrado = buscarValorBinario(marco, largo, "id", &valor) == 1;
+    int esNumero = encontrado && leerNumero(&valor, &numero);
+    int salir = 0;
+
+    if (leerId(clientFD, encontrado, esNumero, numero)) {
+        salir = despacharMarco(clientFD, marco, largo);
+    }
+    terminarSolicitud(clientFD);
+    return salir;
+}
+
+void* manejarCliente(void *arg) {
+    int clientFD = *(int*)arg;
+    free(arg);
+
+    // Los bytes recibidos se guardan en entrada; el flujo solo ubica dónde
+    // termina cada JSON (puede llegar partido o varios en un recv) y el
+    // índice marca dónde empieza cada valor, para parsear en el mismo buffer
+    // solo los campos que se usan. Lo parseado apunta a entrada, así que se
+    // libera antes de mover o reutilizar esos bytes.
+    cJSON_Stream *flujo = cJSON_CreateStream();
+    cJSON_Index *indice = cJSON_CreateIndex();
+    char *entrada = malloc(MAX_SOLICITUD);
+    if (flujo == NULL || indice == NULL || entrada == NULL) {
+        cJSON_DeleteStream(flujo);
+        cJSON_DeleteIndex(indice);
+        free(entrada);
+        close(clientFD);
+        pthread_exit(NULL);
+    }
+    size_t usado = 0;      // Bytes válidos en entrada
+    size_t escaneado = 0;  // Bytes ya revisados por el flujo
+    int descartando = 0;   // El JSON en curso pasó el límite: se tira hasta que termine
+    int resincronizando = 0;  // Ya se respondió JSON_INVALIDO por los bytes que se saltan
+    sesion.version = 1;
+    sesion.indice = -1;
+    sesion.marcoMaximo = MAX_SOLICITUD;  // Hasta que negocie otro en el REGISTRO
+
+    while (1) {
+        vaciarSalida(clientFD);  // Respuestas acumuladas con PIPELINE
+
+        if (usado >= sesion.marcoMaximo) {
+            // Ningún JSON terminó dentro del límite: se tira lo recibido, pero el
+            // flujo lo sigue revisando para retomar justo después de donde termina
+            descartando = 1;
+            usado = 0;
+            escaneado = 0;
+        }
+
+        int bytes = recv(clientFD, entrada + usado, MAX_SOLICITUD - usado, 0);
+        if (bytes <= 0) {
+            printf("[Hilo] Cliente FD: %d desconectado\n", clientFD);
+            break;
+        }
+        usado += (size_t)bytes;
+
+        // Actualizar actividad y estado
+       pthread_mutex_lock(&clientesMutex);
+       for (int i = 0; i < MAX_CLIENTS; i++) {
+           if (clientesConectados[i].activo == 1 && 
+               clientesConectados[i].socketFD == clientFD) {
+               clientesConectados[i].ultimaActividad = time(NULL);
+               cambiarEstado(i, "ACTIVO");  // Resetear a ACTIVO
+               break;
+           }
+       }
+       pthread_mutex_unlock(&clientesMutex);
+
+        int salir = 0;
+        size_t inicio = 0;  // Inicio del mensaje pendiente
+        while (!salir) {
+            if (sesion.formato == FORMATO_BINARIO) {
+                // Marcos: el largo dice cuándo está completo, no hace falta el flujo.
+                // El REGISTRO que pidió el cambio pudo venir en este mismo recv.
+                if (usado - inicio < LARGO_MARCO) {
+                    break;
+                }
+                size_t largo = leerLargoMarco((const unsigned char *)entrada + inicio);
+                if (largo > sesion.marcoMaximo - LARGO_MARCO) {
+                    // Sin delimitadores no hay dónde retomar: se cierra la conexión
+                    responderError(clientFD, "SOLICITUD_DEMASIADO_GRANDE");
+                    salir = 1;
+                    break;
+                }
+                if (usado - inicio < LARGO_MARCO + largo) {
+                    break;  // El marco continúa en el siguiente recv
+                }
+                salir = procesarMarco(clientFD, (unsigned char *)entrada + inicio + LARGO_MARCO, largo);
+                inicio += LARGO_MARCO + largo;
+                escaneado = inicio;
+                continue;
+            }
+            if (escaneado >= usado) {
+                break;
+            }
+
+            size_t usados = 0;
+            cJSON_bool completo = 0;
+            if (!cJSON_StreamScan(flujo, entrada + escaneado, usado - escaneado, &usados, &completo)) {
+                // Algo que no abre un JSON entre mensajes (o un JSON demasiado
+                // anidado): se responde una vez y se retoma en el siguiente '{' o
+                // '[' después del primer byte que no es espacio, así una comilla
+                // suelta no corre los strings que siguen
+                if (!resincronizando) {
+                    responderError(clientFD, "JSON_INVALIDO");
+                    resincronizando = 1;
+                }
+                descartando = 0;
+                cJSON_StreamReset(flujo);
+                while (escaneado < usado && (entrada[escaneado] == ' ' || entrada[escaneado] == '\t' ||
+                                             entrada[escaneado] == '\r' || entrada[escaneado] == '\n')) {
+                    escaneado++;
+                }
+                do {
+                    escaneado++;
+                } while (escaneado < usado && entrada[escaneado] != '{' && entrada[escaneado] != '[');
+                if (escaneado > usado) {
+                    escaneado = usado;
+                }
+                inicio = escaneado;
+                continue;
+            }
+            escaneado += usados;
+            if (completo) {
+                resincronizando = 0;
+            }
+            if (!completo) {
+                if (descartando || cJSON_StreamIsIdle(flujo)) {
+                    inicio = escaneado;  // Solo espacios entre mensajes, o parte del que se tira
+                }
+                break;  // El JSON continúa en el siguiente recv
+            }
+
+            if (descartando || escaneado - inicio > sesion.marcoMaximo) {
+                // Terminó el que se estaba tirando, o llegó completo en un solo
+                // recv pero pasa el límite negociado
+                responderError(clientFD, "SOLICITUD_DEMASIADO_GRANDE");
+                descartando = 0;
+                inicio = escaneado;
+                continue;
+            }
+
+            // Validar todo el documento (gramática y UTF-8) antes de indexarlo;
+            // así los campos que no se leen, o que se reenvían tal cual, también son JSON válido
+            cJSON_Cursor raiz;
+            int indexado = cJSON_Validate(entrada + inicio, escaneado - inicio) &&
+                           cJSON_IndexBuild(indice, entrada + inicio, escaneado - inicio, &raiz);
+            inicio = escaneado;
+            if (!indexado) {
+                responderError(clientFD, "JSON_INVALIDO");
+                continue;
+            }
+            salir = procesarSolicitud(clientFD, &raiz);
+        }
+        if (salir) {
+            break;
+        }
+
+        // Mover el JSON incompleto al inicio del buffer
+        memmove(entrada, entrada + inicio, usado - inicio);
+        usado -= inicio;
+        escaneado -= inicio;
+    }
+
+    vaciarSalida(clientFD);
+    cJSON_DeleteStream(flujo);
+    cJSON_DeleteIndex(indice);
+    cJSON_FreePrintBuffer(&bufferSalida);
+    cJSON_FreePrintBuffer(&bufferPendiente);
+    cJSON_FreePrintBuffer(&bufferDestinos);
+    for (int i = 0; i < NUM_FORMATOS; i++) {
+        cJSON_FreePrintBuffer(&bufferReenvio[i]);
+    }
+    cJSON_FreePrintBuffer(&bufferOriginal);
+    free(entrada);
+    liberarCliente(clientFD);
+    close(clientFD);
+    pthread_exit(NULL);
+    return NULL;
+}
+
+int main() {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        clientesConectados[i].activo = 0;
         strcpy(clientesConectados[i].status, "ACTIVO");
     }
+    for (int i = 0; i < CANDADOS_ENVIO; i++) {
+        pthread_mutex_init(&candadosEnvio[i], NULL);
+    }
+    versionRegistro = versionInicial = (long)time(NULL) << 20;
+
+    // La ventana de presencia se puede cambiar al iniciar, sin recompilar
+    const char *ventana = getenv("VENTANA_PRESENCIA_MS");
+    if (ventana != NULL) {
+        char *fin;
+        long ms = strtol(ventana, &fin, 10);
+        if (fin == ventana || *fin != '\0' || ms < 0 || ms > 60000) {
+            fprintf(stderr, "VENTANA_PRESENCIA_MS debe ser un entero entre 0 y 60000\n");
+            exit(EXIT_FAILURE);
+        }
+        ventanaPresencia = ms;
+    }
+
+    if (!crearPlantillas()) {
+        fprintf(stderr, "Error al crear las plantillas de salida\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!crearTablaDespacho()) {
+        fprintf(stderr, "Error al crear la tabla de despacho\n");
+        exit(EXIT_FAILURE);
+    }
 
     // Iniciar hilo de verificación de inactividad
     pthread_t hilo_verificador;
@@ -413,6 +2097,14 @@ int main() {
     }
     pthread_detach(hilo_verificador);
 
+    // Hilo que publica los cambios de presencia
+    pthread_t hiloPresencia;
+    if (pthread_create(&hiloPresencia, NULL, publicarPresencia, NULL) != 0) {
+        perror("Error al crear hilo de presencia");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(hiloPresencia);
+
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0) {
         perror("socket");